@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "InputFile.h"
+#include "profiler/profiler.h"
+
+// Repetition tester: runs every read strategy on the same file over and over
+// and keeps the fastest run, the one least disturbed by the rest of the system.
+// A strategy is done once its minimum hasn't improved for a while.
+
+struct RepetitionResults
+{
+    u64 testCount;
+    u64 totalTime;
+    u64 minTime;
+    u64 maxTime;
+    u64 totalPageFaults;
+    u64 minTimePageFaults;
+    u64 maxPageFaults;
+};
+
+struct RepetitionTester
+{
+    u64 byteCount;
+    u64 cpuTimerFrequency;
+    // how long the minimum may go without improving before the test ends
+    u64 tryForTime;
+    u64 testsStartedAt;
+    bool failed;
+
+    // current run
+    u64 startTime;
+    u64 startPageFaults;
+
+    RepetitionResults results;
+};
+
+u64 readPageFaults()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (u64)(usage.ru_minflt + usage.ru_majflt);
+}
+
+void startTesting(RepetitionTester *tester, u64 byteCount, u64 cpuTimerFrequency, u64 seconds)
+{
+    *tester = RepetitionTester();
+    tester->byteCount = byteCount;
+    tester->cpuTimerFrequency = cpuTimerFrequency;
+    tester->tryForTime = seconds * cpuTimerFrequency;
+    tester->results.minTime = (u64)-1;
+    tester->testsStartedAt = readCpuTimer();
+}
+
+void beginTime(RepetitionTester *tester)
+{
+    tester->startPageFaults = readPageFaults();
+    tester->startTime = readCpuTimer();
+}
+
+void endTime(RepetitionTester *tester)
+{
+    u64 elapsed = readCpuTimer() - tester->startTime;
+    u64 pageFaults = readPageFaults() - tester->startPageFaults;
+
+    RepetitionResults *results = &tester->results;
+    results->testCount++;
+    results->totalTime += elapsed;
+    results->totalPageFaults += pageFaults;
+    if (elapsed > results->maxTime)
+    {
+        results->maxTime = elapsed;
+    }
+    if (pageFaults > results->maxPageFaults)
+    {
+        results->maxPageFaults = pageFaults;
+    }
+    if (elapsed < results->minTime)
+    {
+        results->minTime = elapsed;
+        results->minTimePageFaults = pageFaults;
+        // a new minimum restarts the clock
+        tester->testsStartedAt = readCpuTimer();
+        printf("\r  Min so far: %.4fms", 1000.0 * (f64)elapsed / (f64)tester->cpuTimerFrequency);
+        fflush(stdout);
+    }
+}
+
+void failTest(RepetitionTester *tester, const char *message)
+{
+    printf("\n  Error: %s\n", message);
+    tester->failed = true;
+}
+
+bool isTesting(RepetitionTester *tester)
+{
+    return !tester->failed && readCpuTimer() - tester->testsStartedAt < tester->tryForTime;
+}
+
+void printTime(const char *label, f64 time, u64 cpuTimerFrequency, u64 byteCount, f64 pageFaults)
+{
+    f64 seconds = time / (f64)cpuTimerFrequency;
+    f64 gigabytes = (f64)byteCount / (1024.0 * 1024.0 * 1024.0);
+    printf("  %s: %.4fms %.3fGB/s", label, 1000.0 * seconds, gigabytes / seconds);
+    if (pageFaults > 0)
+    {
+        printf(" %.1f faults (%.2fKB/fault)", pageFaults, (f64)byteCount / pageFaults / 1024.0);
+    }
+    printf("\n");
+}
+
+void printResults(RepetitionTester *tester)
+{
+    RepetitionResults *results = &tester->results;
+    if (results->testCount == 0)
+    {
+        return;
+    }
+    printf("\r%40s\r", "");
+    printTime("Min", (f64)results->minTime, tester->cpuTimerFrequency, tester->byteCount, (f64)results->minTimePageFaults);
+    printTime("Max", (f64)results->maxTime, tester->cpuTimerFrequency, tester->byteCount, (f64)results->maxPageFaults);
+    printTime("Avg", (f64)results->totalTime / results->testCount, tester->cpuTimerFrequency, tester->byteCount,
+              (f64)results->totalPageFaults / results->testCount);
+    printf("  %llu runs\n", (unsigned long long)results->testCount);
+}
+
+// What parse() used to do: fopen/fread into a fresh new char[] every time
+void testFread(RepetitionTester *tester, const char *fileName)
+{
+    while (isTesting(tester))
+    {
+        beginTime(tester);
+        FILE *file = fopen(fileName, "rb");
+        if (!file)
+        {
+            failTest(tester, "fopen failed");
+            break;
+        }
+        char *buffer = new char[tester->byteCount + 1];
+        u64 bytesRead = fread(buffer, 1, tester->byteCount, file);
+        buffer[tester->byteCount] = 0;
+        fclose(file);
+        delete[] buffer;
+        endTime(tester);
+
+        if (bytesRead != tester->byteCount)
+        {
+            failTest(tester, "fread failed");
+        }
+    }
+}
+
+// read() into a buffer allocated once, its pages are already faulted in after
+// the first run
+void testReadReused(RepetitionTester *tester, const char *fileName)
+{
+    char *buffer = (char *)malloc(tester->byteCount + inputPadding);
+    while (isTesting(tester))
+    {
+        beginTime(tester);
+        int fd = open(fileName, O_RDONLY);
+        if (fd < 0)
+        {
+            failTest(tester, "open failed");
+            break;
+        }
+        try
+        {
+            readFully(fd, buffer, tester->byteCount);
+        }
+        catch (const std::exception &e)
+        {
+            failTest(tester, e.what());
+        }
+        close(fd);
+        endTime(tester);
+    }
+    free(buffer);
+}
+
+// keeps the page touching loop from being optimized away
+volatile char touchedBytes;
+
+// openInputFile() with the given options. Mapped pages are only faulted in
+// when read, so every page is touched to make the runs comparable.
+void testInputFile(RepetitionTester *tester, const char *fileName, const LoadOptions &options)
+{
+    Arena arena = Arena();
+    u64 pageSize = getPageSize();
+    while (isTesting(tester))
+    {
+        arena.reset();
+        InputFile input = InputFile();
+        beginTime(tester);
+        try
+        {
+            openInputFile(fileName, &input, options, &arena);
+            char touched = 0;
+            for (u64 i = 0; i < input.size; i += pageSize)
+            {
+                touched ^= input.data[i];
+            }
+            touchedBytes = touched;
+        }
+        catch (const std::exception &e)
+        {
+            failTest(tester, e.what());
+        }
+        closeInputFile(&input);
+        endTime(tester);
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    const char *fileName = NULL;
+    u64 seconds = 10;
+    bool validArguments = true;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            // checked signed, a negative count would wrap around in the u64
+            int parsedSeconds = atoi(argv[++i]);
+            validArguments = validArguments && parsedSeconds > 0;
+            seconds = parsedSeconds > 0 ? (u64)parsedSeconds : seconds;
+        }
+        else if (argv[i][0] != '-' && !fileName)
+        {
+            fileName = argv[i];
+        }
+        else
+        {
+            validArguments = false;
+        }
+    }
+
+    struct stat info;
+    if (!validArguments || !fileName || stat(fileName, &info) != 0 || info.st_size == 0)
+    {
+        printf("Usage:   haversine_benchmark [options] input.json\n");
+        printf("\n");
+        printf("Options: --seconds [n] stop a strategy once its minimum hasn't improved\n");
+        printf("                       for n seconds (default 10)\n");
+        return 1;
+    }
+
+    u64 byteCount = (u64)info.st_size;
+    u64 cpuTimerFrequency = estimateCpuTimerFrequency();
+    printf("%s: %llu bytes, CPU timer at %llu Hz\n", fileName, (unsigned long long)byteCount, (unsigned long long)cpuTimerFrequency);
+
+    LoadOptions read = LoadOptions();
+    LoadOptions readHugePages = LoadOptions();
+    readHugePages.hugePages = true;
+    LoadOptions map = LoadOptions();
+    map.mode = LoadOptions::MMAP;
+    LoadOptions mapPopulate = map;
+    mapPopulate.populate = true;
+    LoadOptions mapHugePages = map;
+    mapHugePages.hugePages = true;
+
+    RepetitionTester tester;
+    for (int strategy = 0; strategy < 7; strategy++)
+    {
+        startTesting(&tester, byteCount, cpuTimerFrequency, seconds);
+        switch (strategy)
+        {
+        case 0:
+            printf("\n--- fread into new char[] ---\n");
+            testFread(&tester, fileName);
+            break;
+        case 1:
+            printf("\n--- read into a reused buffer ---\n");
+            testReadReused(&tester, fileName);
+            break;
+        case 2:
+            printf("\n--- read into the arena (parse default) ---\n");
+            testInputFile(&tester, fileName, read);
+            break;
+        case 3:
+            printf("\n--- read into huge pages ---\n");
+            testInputFile(&tester, fileName, readHugePages);
+            break;
+        case 4:
+            printf("\n--- mmap ---\n");
+            testInputFile(&tester, fileName, map);
+            break;
+        case 5:
+            printf("\n--- mmap with prefault ---\n");
+            testInputFile(&tester, fileName, mapPopulate);
+            break;
+        case 6:
+            printf("\n--- mmap with huge pages ---\n");
+            testInputFile(&tester, fileName, mapHugePages);
+            break;
+        }
+        printResults(&tester);
+    }
+
+    return 0;
+}
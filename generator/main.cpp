@@ -2,119 +2,288 @@
 #include <stdlib.h>
 #include <random>
 #include <string.h>
+#include <charconv>
+#include <thread>
+#include <vector>
 #include "solver/solver.h"
+#include "solver/sum.h"
+#include "solver/binary.h"
+#include "profiler/profiler.h"
+#include "processor/JsonWriter.h"
 #include <algorithm>
 
-int main(int argc, char const *argv[])
-{
-    if (argc != 4)
-    {
-        printf("Usage: %s [uniform/cluster] [random seed] [number of coordinate pairs to generate]\n", argv[0]);
-        return 1;
-    }
-
-    const char *mode = argv[1];
-    int seed = atoi(argv[2]);
-    int pairsCount = atoi(argv[3]);
+// Pairs are generated in fixed size chunks, each with its own RNG stream
+// seeded from (seed, chunk index), so a chunk's content doesn't depend on
+// which thread produced it and the files only depend on the seed.
+static const u64 pairsPerChunk = 1 << 16;
 
-    // print cool things
+static const int clusterCount = 18;
 
-    printf("Generating %d coordinate pairs using %s mode with seed %d\n", pairsCount, mode, seed);
+struct Cluster
+{
+    int minX, minY, maxX, maxY;
+};
 
-    std::mt19937_64 rng(seed);
+struct GeneratorChunk
+{
+    u64 first;
+    u64 count;
+    JsonWriter json;
+    f64 *distances;
+    // x0, y0, x1 and y1 of every pair, only kept for the binary file
+    f64 *columns[4];
+    Sum sum;
+};
 
-    // create a json file
-    char fileName[128];
-    sprintf(fileName, "storage/coordinates_%s_%d_%d.json", mode, seed, pairsCount);
-    FILE *jsonFile = fopen(fileName, "wb");
-    fprintf(jsonFile, "{\"pairs\":[\n");
+struct Generator
+{
+    bool isCluster;
+    int seed;
+    u64 pairsCount;
+    Cluster clusters[clusterCount];
+    SumMode sumMode;
+};
 
-    // create a result file
-    sprintf(fileName, "storage/results_%s_%d_%d.f64", mode, seed, pairsCount);
-    FILE *resultFile = fopen(fileName, "wb");
+void generateChunk(const Generator *generator, GeneratorChunk *chunk)
+{
+    std::seed_seq seeds = {(uint32_t)generator->seed, (uint32_t)(chunk->first / pairsPerChunk), (uint32_t)(chunk->first / pairsPerChunk >> 32)};
+    std::mt19937_64 rng(seeds);
+    initSum(&chunk->sum, generator->sumMode);
 
-    f64 totalDistance = 0.0;
-    bool isUniform = strcmp(mode, "uniform") == 0;
-    bool isCluster = strcmp(mode, "cluster") == 0;
-    double x0, y0, x1, y1;
-    int minX, minY, maxX, maxY;
+    // the chunk continues the "pairs" array, one record per line
+    JsonWriter *json = &chunk->json;
+    initJsonWriter(json, false);
+    json->depth = 2;
+    json->breakDepth = 3;
+    json->needsSeparator = chunk->first > 0;
 
-    // generate coordinate pairs
-    if (isUniform)
+    u64 pairsPerCluster = generator->pairsCount / clusterCount;
+    for (u64 i = 0; i < chunk->count; i++)
     {
-        for (int i = 0; i < pairsCount; i++)
+        u64 index = chunk->first + i;
+        f64 x0, y0, x1, y1;
+        if (generator->isCluster)
+        {
+            // same split as before: equal runs of pairs, the remainder in the last cluster
+            u64 cluster = pairsPerCluster ? index / pairsPerCluster : clusterCount - 1;
+            const Cluster *bounds = &generator->clusters[std::min(cluster, (u64)clusterCount - 1)];
+            x0 = rng() / (double)rng.max() * (bounds->maxX - bounds->minX) + bounds->minX;
+            y0 = rng() / (double)rng.max() * (bounds->maxY - bounds->minY) + bounds->minY;
+            x1 = rng() / (double)rng.max() * (bounds->maxX - bounds->minX) + bounds->minX;
+            y1 = rng() / (double)rng.max() * (bounds->maxY - bounds->minY) + bounds->minY;
+        }
+        else
         {
-
             x0 = rng() / (double)rng.max() * 360.0 - 180.0;
             y0 = rng() / (double)rng.max() * 180.0 - 90.0;
             x1 = rng() / (double)rng.max() * 360.0 - 180.0;
             y1 = rng() / (double)rng.max() * 180.0 - 90.0;
+        }
 
-            fprintf(jsonFile, "{\"x0\":%.20f,\"y0\":%.20f,\"x1\":%.20f,\"y1\":%.20f}", x0, y0, x1, y1);
+        writeObjectBegin(json);
+        writeKey(json, "x0", 2);
+        writeNumber(json, x0);
+        writeKey(json, "y0", 2);
+        writeNumber(json, y0);
+        writeKey(json, "x1", 2);
+        writeNumber(json, x1);
+        writeKey(json, "y1", 2);
+        writeNumber(json, y1);
+        writeObjectEnd(json);
 
-            if (i < pairsCount - 1)
-            {
-                fprintf(jsonFile, ",\n");
-            }
+        if (chunk->columns[0])
+        {
+            chunk->columns[0][i] = x0;
+            chunk->columns[1][i] = y0;
+            chunk->columns[2][i] = x1;
+            chunk->columns[3][i] = y1;
+        }
 
-            // calculate distance
-            f64 distance = referenceHaversine(x0, y0, x1, y1, 6372.8);
-            totalDistance += distance;
+        // calculate distance
+        f64 distance = referenceHaversine(x0, y0, x1, y1, 6372.8);
+        chunk->distances[i] = distance;
+        addToSum(&chunk->sum, distance);
+    }
+}
 
-            // write to result file
-            fwrite(&distance, sizeof(f64), 1, resultFile);
+int main(int argc, char const *argv[])
+{
+    // split the flags from the positional arguments
+    const char *arguments[4] = {NULL, NULL, NULL, NULL};
+    int argumentsCount = 0;
+    bool validArguments = true;
+    int threadCount = 1;
+    bool writeBinary = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+            validArguments = validArguments && threadCount > 0;
+        }
+        else if (strcmp(argv[i], "--binary") == 0)
+        {
+            writeBinary = true;
+        }
+        else if (argv[i][0] != '-' && argumentsCount < 4)
+        {
+            arguments[argumentsCount++] = argv[i];
+        }
+        else
+        {
+            validArguments = false;
         }
     }
-    else if (isCluster)
+
+    // the average is summed exactly by default
+    SumMode sumMode = SUM_EXACT;
+    if (!validArguments || argumentsCount < 3 || (argumentsCount == 4 && !getSumMode(arguments[3], &sumMode)))
+    {
+        printf("Usage: %s [options] [uniform/cluster] [random seed] [number of coordinate pairs to generate] [naive/pairwise/neumaier/exact]\n", argv[0]);
+        printf("\n");
+        printf("Options: --threads [n] generate chunks of pairs on n threads, the output\n");
+        printf("                       is the same for any n\n");
+        printf("         --binary      also write the coordinates as f64 columns in a\n");
+        printf("                       .bin file the processor can load without parsing\n");
+        return 1;
+    }
+
+    beginProfile();
+
+    const char *mode = arguments[0];
+    int seed = atoi(arguments[1]);
+    u64 pairsCount = strtoull(arguments[2], NULL, 10);
+
+    Generator generator = Generator();
+    generator.seed = seed;
+    generator.pairsCount = pairsCount;
+    generator.sumMode = sumMode;
+    bool isUniform = strcmp(mode, "uniform") == 0;
+    generator.isCluster = strcmp(mode, "cluster") == 0;
+    if (!isUniform && !generator.isCluster)
+    {
+        printf("Invalid mode: %s\n", mode);
+        return 1;
+    }
+
+    // print cool things
+
+    printf("Generating %llu coordinate pairs using %s mode with seed %d\n", (unsigned long long)pairsCount, mode, seed);
+
+    if (generator.isCluster)
     {
-        int clusterCount = 18;
-        int counter = 0;
+        std::mt19937_64 rng(seed);
         for (int i = 0; i < clusterCount; i++)
         {
-            minX = rng() / (double)rng.max() * 360.0 - 180.0;
-            minY = rng() / (double)rng.max() * 180.0 - 90.0;
-            maxX = std::min(minX + rng() / (double)rng.max() * 180.0, 180.0);
-            maxY = std::min(minY + rng() / (double)rng.max() * 90.0, 90.0);
+            Cluster *cluster = &generator.clusters[i];
+            cluster->minX = rng() / (double)rng.max() * 360.0 - 180.0;
+            cluster->minY = rng() / (double)rng.max() * 180.0 - 90.0;
+            cluster->maxX = std::min(cluster->minX + rng() / (double)rng.max() * 180.0, 180.0);
+            cluster->maxY = std::min(cluster->minY + rng() / (double)rng.max() * 90.0, 90.0);
+        }
+    }
 
-            int maxIndex = pairsCount / clusterCount * (i + 1);
-            if (i == clusterCount - 1)
-            {
-                maxIndex = pairsCount;
-            }
+    // create a json file
+    char fileName[128];
+    sprintf(fileName, "storage/coordinates_%s_%d_%llu.json", mode, seed, (unsigned long long)pairsCount);
+    FILE *jsonFile = fopen(fileName, "wb");
+    fprintf(jsonFile, "{\"pairs\":[");
 
-            while (counter < maxIndex)
-            {
-                x0 = rng() / (double)rng.max() * (maxX - minX) + minX;
-                y0 = rng() / (double)rng.max() * (maxY - minY) + minY;
-                x1 = rng() / (double)rng.max() * (maxX - minX) + minX;
-                y1 = rng() / (double)rng.max() * (maxY - minY) + minY;
+    // create a result file
+    sprintf(fileName, "storage/results_%s_%d_%llu.f64", mode, seed, (unsigned long long)pairsCount);
+    FILE *resultFile = fopen(fileName, "wb");
+
+    // columns are written in place, the header once the checksum is known
+    FILE *binaryFile = NULL;
+    PairsChecksum checksum = PairsChecksum();
+    if (writeBinary)
+    {
+        sprintf(fileName, "storage/coordinates_%s_%d_%llu.bin", mode, seed, (unsigned long long)pairsCount);
+        binaryFile = fopen(fileName, "wb");
+    }
+
+    Sum totalDistance;
+    initSum(&totalDistance, sumMode);
 
-                fprintf(jsonFile, "{\"x0\":%.20f,\"y0\":%.20f,\"x1\":%.20f,\"y1\":%.20f}", x0, y0, x1, y1);
+    // one buffer per thread, reused for every round of chunks
+    std::vector<GeneratorChunk> chunks(threadCount);
+    for (GeneratorChunk &chunk : chunks)
+    {
+        chunk.distances = new f64[pairsPerChunk];
+        for (int column = 0; column < 4; column++)
+        {
+            chunk.columns[column] = writeBinary ? new f64[pairsPerChunk] : NULL;
+        }
+    }
 
-                if (counter < pairsCount - 1)
+    for (u64 first = 0; first < pairsCount; first += pairsPerChunk * threadCount)
+    {
+        int roundChunks = 0;
+        {
+            TIME_BLOCK("generatePairs");
+            std::vector<std::thread> threads;
+            for (int i = 0; i < threadCount; i++)
+            {
+                u64 chunkFirst = first + pairsPerChunk * i;
+                if (chunkFirst >= pairsCount)
                 {
-                    fprintf(jsonFile, ",\n");
+                    break;
                 }
+                chunks[i].first = chunkFirst;
+                chunks[i].count = std::min(pairsPerChunk, pairsCount - chunkFirst);
+                roundChunks++;
+                if (threadCount == 1)
+                {
+                    generateChunk(&generator, &chunks[i]);
+                }
+                else
+                {
+                    threads.emplace_back(generateChunk, &generator, &chunks[i]);
+                }
+            }
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+        }
 
-                // calculate distance
-                f64 distance = referenceHaversine(x0, y0, x1, y1, 6372.8);
-                totalDistance += distance;
-
-                // write to result file
-                fwrite(&distance, sizeof(f64), 1, resultFile);
+        // chunks go out in order, and their sums are merged in the same order
+        TIME_BLOCK("writePairs");
+        for (int i = 0; i < roundChunks; i++)
+        {
+            fwrite(chunks[i].json.buffer, 1, chunks[i].json.size, jsonFile);
+            fwrite(chunks[i].distances, sizeof(f64), chunks[i].count, resultFile);
+            mergeSum(&totalDistance, &chunks[i].sum);
 
-                counter++;
+            for (int column = 0; binaryFile && column < 4; column++)
+            {
+                fseeko(binaryFile, getBinaryColumnOffset(pairsCount, column) + chunks[i].first * sizeof(f64), SEEK_SET);
+                fwrite(chunks[i].columns[column], sizeof(f64), chunks[i].count, binaryFile);
+                addToPairsChecksum(&checksum, column, chunks[i].columns[column], chunks[i].count);
             }
         }
     }
-    else
+
+    for (GeneratorChunk &chunk : chunks)
     {
-        printf("Invalid mode: %s\n", mode);
-        return 1;
+        delete[] chunk.distances;
+        for (int column = 0; column < 4; column++)
+        {
+            delete[] chunk.columns[column];
+        }
+    }
+
+    if (binaryFile)
+    {
+        BinaryPairsHeader header;
+        initBinaryPairsHeader(&header, pairsCount, getPairsChecksum(&checksum));
+        fseeko(binaryFile, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, binaryFile);
+        fclose(binaryFile);
     }
 
     // compute the average distance
-    f64 averageDistance = totalDistance / pairsCount;
+    f64 averageDistance = getSum(&totalDistance) / pairsCount;
     // print cool things
     printf("Average distance: %.20f\n", averageDistance);
     // write to result file
@@ -125,5 +294,7 @@ int main(int argc, char const *argv[])
     fprintf(jsonFile, "]}");
     fclose(jsonFile);
 
+    endAndPrintProfile();
+
     return 0;
 }
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+
+// Bump allocator: every allocation is a pointer increment inside a block,
+// nothing is freed individually. reset() rewinds all blocks without giving
+// them back to the system so the next document reuses the same memory.
+class Arena
+{
+private:
+    struct Block
+    {
+        Block *next;
+        size_t capacity;
+        size_t used;
+    };
+
+    static const size_t maxBlockSize = (size_t)64 << 20;
+
+    Block *first;
+    Block *current;
+    size_t blockSize;
+
+    static char *blockData(Block *block)
+    {
+        return (char *)block + sizeof(Block);
+    }
+
+    static size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    static char *tryAllocate(Block *block, size_t size, size_t alignment)
+    {
+        size_t base = (size_t)blockData(block);
+        size_t offset = alignUp(base + block->used, alignment) - base;
+        if (offset + size > block->capacity)
+        {
+            return NULL;
+        }
+        block->used = offset + size;
+        return blockData(block) + offset;
+    }
+
+    Block *newBlock(size_t minimumSize)
+    {
+        size_t capacity = blockSize;
+        if (capacity < minimumSize)
+        {
+            capacity = minimumSize;
+        }
+        // grow geometrically so big documents end up in a handful of blocks
+        if (blockSize < maxBlockSize)
+        {
+            blockSize *= 2;
+        }
+
+        Block *block = (Block *)malloc(sizeof(Block) + capacity);
+        if (!block)
+        {
+            throw std::bad_alloc();
+        }
+        block->next = NULL;
+        block->capacity = capacity;
+        block->used = 0;
+        return block;
+    }
+
+    void freeBlocks()
+    {
+        Block *block = first;
+        while (block)
+        {
+            Block *next = block->next;
+            free(block);
+            block = next;
+        }
+        first = NULL;
+        current = NULL;
+    }
+
+public:
+    Arena(size_t blockSize = 64 * 1024)
+    {
+        first = NULL;
+        current = NULL;
+        this->blockSize = blockSize;
+    }
+
+    ~Arena()
+    {
+        freeBlocks();
+    }
+
+    Arena(Arena &&other)
+    {
+        first = other.first;
+        current = other.current;
+        blockSize = other.blockSize;
+        other.first = NULL;
+        other.current = NULL;
+    }
+
+    Arena &operator=(Arena &&other)
+    {
+        if (this != &other)
+        {
+            freeBlocks();
+            first = other.first;
+            current = other.current;
+            blockSize = other.blockSize;
+            other.first = NULL;
+            other.current = NULL;
+        }
+        return *this;
+    }
+
+    Arena &operator=(const Arena &other) = delete;
+    Arena(const Arena &other) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(max_align_t))
+    {
+        if (current)
+        {
+            char *pointer = tryAllocate(current, size, alignment);
+            if (pointer)
+            {
+                return pointer;
+            }
+
+            // reuse the blocks left over from a previous reset() before asking for more
+            while (current->next)
+            {
+                current = current->next;
+                pointer = tryAllocate(current, size, alignment);
+                if (pointer)
+                {
+                    return pointer;
+                }
+            }
+        }
+
+        Block *block = newBlock(size + alignment);
+        if (current)
+        {
+            current->next = block;
+        }
+        else
+        {
+            first = block;
+        }
+        current = block;
+
+        return tryAllocate(block, size, alignment);
+    }
+
+    // Destructors of arena objects are never run, the memory just goes away on reset()
+    template <typename T, typename... Args>
+    T *create(Args... args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(args...);
+    }
+
+    template <typename T>
+    T *allocateArray(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena arrays are never destroyed");
+        return (T *)allocate(sizeof(T) * count, alignof(T));
+    }
+
+    void reset()
+    {
+        for (Block *block = first; block; block = block->next)
+        {
+            block->used = 0;
+        }
+        current = first;
+    }
+
+    size_t getUsed() const
+    {
+        size_t used = 0;
+        for (Block *block = first; block; block = block->next)
+        {
+            used += block->used;
+        }
+        return used;
+    }
+
+    size_t getCapacity() const
+    {
+        size_t capacity = 0;
+        for (Block *block = first; block; block = block->next)
+        {
+            capacity += block->capacity;
+        }
+        return capacity;
+    }
+};
@@ -1,66 +1,267 @@
+#pragma once
+
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "Arena.h"
+
+// Where list buffers come from: the arena when there is one, the heap
+// otherwise. Buffers taken from an arena are released with it, never
+// individually.
+struct ListAllocator
+{
+    Arena *arena = NULL;
+
+    void *allocate(size_t bytes, size_t alignment)
+    {
+        if (arena)
+        {
+            return arena->allocate(bytes, alignment);
+        }
+        void *memory = malloc(bytes);
+        if (!memory)
+        {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
 
-template <typename T>
+    // Only for trivially copyable contents: realloc can move the buffer
+    // without the elements knowing
+    void *reallocate(void *memory, size_t oldBytes, size_t bytes, size_t alignment)
+    {
+        if (arena)
+        {
+            void *copy = arena->allocate(bytes, alignment);
+            if (oldBytes > 0)
+            {
+                memcpy(copy, memory, oldBytes);
+            }
+            return copy;
+        }
+        void *grown = realloc(memory, bytes);
+        if (!grown)
+        {
+            throw std::bad_alloc();
+        }
+        return grown;
+    }
+
+    void deallocate(void *memory)
+    {
+        if (!arena)
+        {
+            free(memory);
+        }
+    }
+};
+
+template <typename T, typename Allocator = ListAllocator>
 class ArrayList
 {
 private:
     T *array;
-    int capacity;
-    int size;
+    size_t capacity;
+    size_t size;
+    Allocator allocator;
+
+    void setCapacity(size_t newCapacity)
+    {
+        static_assert(alignof(T) <= alignof(max_align_t), "ArrayList buffers are only aligned to max_align_t");
+        if constexpr (std::is_trivially_copyable<T>::value)
+        {
+            array = (T *)allocator.reallocate(array, size * sizeof(T), newCapacity * sizeof(T), alignof(T));
+        }
+        else
+        {
+            T *newArray = (T *)allocator.allocate(newCapacity * sizeof(T), alignof(T));
+            for (size_t i = 0; i < size; i++)
+            {
+                new (&newArray[i]) T(std::move(array[i]));
+                array[i].~T();
+            }
+            allocator.deallocate(array);
+            array = newArray;
+        }
+        capacity = newCapacity;
+    }
+
+    void grow()
+    {
+        setCapacity(capacity ? capacity * 2 : 8);
+    }
+
+    void destroyElements()
+    {
+        if constexpr (!std::is_trivially_destructible<T>::value)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                array[i].~T();
+            }
+        }
+        size = 0;
+    }
 
 public:
-    ArrayList()
+    // Nothing is allocated until the first element, empty lists are free
+    explicit ArrayList(const Allocator &allocator = Allocator())
     {
-        capacity = 10;
-        array = new T[capacity];
+        array = NULL;
+        capacity = 0;
         size = 0;
+        this->allocator = allocator;
+    }
+
+    ArrayList(Arena *arena)
+    {
+        array = NULL;
+        capacity = 0;
+        size = 0;
+        allocator.arena = arena;
     }
 
     ~ArrayList()
     {
-        delete[] array;
+        destroyElements();
+        allocator.deallocate(array);
+    }
+
+    ArrayList(ArrayList &&other)
+    {
+        array = other.array;
+        capacity = other.capacity;
+        size = other.size;
+        allocator = other.allocator;
+        other.array = NULL;
+        other.capacity = 0;
+        other.size = 0;
+    }
+
+    ArrayList &operator=(ArrayList &&other)
+    {
+        if (this != &other)
+        {
+            destroyElements();
+            allocator.deallocate(array);
+            array = other.array;
+            capacity = other.capacity;
+            size = other.size;
+            allocator = other.allocator;
+            other.array = NULL;
+            other.capacity = 0;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    ArrayList &operator=(const ArrayList &other) = delete;
+    ArrayList(const ArrayList &other) = delete;
+
+    void reserve(size_t count)
+    {
+        if (count > capacity)
+        {
+            setCapacity(count);
+        }
     }
 
     void add(const T &element)
     {
         if (size == capacity)
         {
-            capacity *= 2;
-            T *newArray = new T[capacity];
-            for (int i = 0; i < size; i++)
-            {
-                newArray[i] = array[i];
-            }
-            delete[] array;
-            array = newArray;
+            // element may live in the buffer that is about to move
+            T copy(element);
+            grow();
+            new (&array[size]) T(std::move(copy));
+        }
+        else
+        {
+            new (&array[size]) T(element);
         }
-        array[size] = element;
         size++;
     }
 
-    T &operator[](int index)
+    void add(T &&element)
     {
-        if (index < 0 || index >= size)
+        if (size == capacity)
+        {
+            T moved(std::move(element));
+            grow();
+            new (&array[size]) T(std::move(moved));
+        }
+        else
+        {
+            new (&array[size]) T(std::move(element));
+        }
+        size++;
+    }
+
+    void clear()
+    {
+        destroyElements();
+    }
+
+    // Unchecked, use at() for indices that come from outside
+    T &operator[](size_t index)
+    {
+        return array[index];
+    }
+
+    const T &operator[](size_t index) const
+    {
+        return array[index];
+    }
+
+    T &at(size_t index)
+    {
+        if (index >= size)
         {
             throw std::out_of_range("Index out of bounds");
         }
         return array[index];
     }
 
-    const T &operator[](int index) const
+    const T &at(size_t index) const
     {
-        if (index < 0 || index >= size)
+        if (index >= size)
         {
             throw std::out_of_range("Index out of bounds");
         }
         return array[index];
     }
 
-    int getSize() const
+    T *begin()
+    {
+        return array;
+    }
+
+    T *end()
+    {
+        return array + size;
+    }
+
+    const T *begin() const
+    {
+        return array;
+    }
+
+    const T *end() const
+    {
+        return array + size;
+    }
+
+    size_t getSize() const
     {
         return size;
     }
 
-    ArrayList &operator=(const ArrayList &other) = delete;
-    ArrayList(const ArrayList &other) = delete;
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
 };
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+
+typedef double f64;
+typedef uint64_t u64;
+
+// Many inputs in one process: the files of a directory or a manifest go
+// through a queue, largest first so a big file picked last doesn't leave the
+// other workers idle, and every worker keeps its buffers from one file to the
+// next.
+
+enum BatchStatus
+{
+    BATCH_PENDING,
+    // parsed and computed, no answers to compare with
+    BATCH_COMPUTED,
+    BATCH_CORRECT,
+    BATCH_MISMATCH,
+    BATCH_FAILED,
+};
+
+struct BatchFile
+{
+    std::string input;
+    // empty when the input has no answers
+    std::string answers;
+    u64 size;
+
+    BatchStatus status;
+    // why it failed, for the report
+    std::string error;
+    u64 count;
+    f64 totalDistance;
+    f64 averageDistance;
+    u64 mismatches;
+    u64 maxUlp;
+    u64 nanoseconds;
+};
+
+inline bool isFile(const std::string &path, u64 *size)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        return false;
+    }
+    *size = info.st_size;
+    return true;
+}
+
+inline void addBatchFile(std::vector<BatchFile> *files, const std::string &input, const std::string &answers)
+{
+    BatchFile file = BatchFile();
+    file.input = input;
+    file.answers = answers;
+    file.status = BATCH_PENDING;
+    if (!isFile(input, &file.size))
+    {
+        file.status = BATCH_FAILED;
+        file.error = "Can't read the input";
+    }
+    files->push_back(file);
+}
+
+// Every coordinates_<name>.json of the directory, with results_<name>.f64
+// next to it as its answers if there is one
+inline bool listBatchDirectory(const char *path, std::vector<BatchFile> *files)
+{
+    DIR *directory = opendir(path);
+    if (!directory)
+    {
+        return false;
+    }
+
+    std::vector<std::string> names;
+    while (dirent *entry = readdir(directory))
+    {
+        u64 length = strlen(entry->d_name);
+        if (length > 17 && strncmp(entry->d_name, "coordinates_", 12) == 0 && strcmp(entry->d_name + length - 5, ".json") == 0)
+        {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(directory);
+
+    // the report lists the files in name order, whatever order they ran in
+    std::sort(names.begin(), names.end());
+    std::string prefix = std::string(path) + "/";
+    for (const std::string &name : names)
+    {
+        std::string answers = prefix + "results_" + name.substr(12, name.size() - 17) + ".f64";
+        u64 size;
+        addBatchFile(files, prefix + name, isFile(answers, &size) ? answers : std::string());
+    }
+    return true;
+}
+
+// One input per line, optionally followed by its answers, separated by
+// whitespace. Relative paths are relative to the manifest, # starts a comment.
+inline bool listBatchManifest(const char *path, std::vector<BatchFile> *files)
+{
+    FILE *manifest = fopen(path, "r");
+    if (!manifest)
+    {
+        return false;
+    }
+
+    const char *slash = strrchr(path, '/');
+    std::string base = slash ? std::string(path, slash + 1 - path) : std::string();
+    char line[4096];
+    while (fgets(line, sizeof(line), manifest))
+    {
+        char *comment = strchr(line, '#');
+        if (comment)
+        {
+            *comment = '\0';
+        }
+        char *input = strtok(line, " \t\r\n");
+        if (!input)
+        {
+            continue;
+        }
+        char *answers = strtok(NULL, " \t\r\n");
+        std::string inputPath = input[0] == '/' ? input : base + input;
+        std::string answersPath = !answers ? std::string() : answers[0] == '/' ? answers : base + answers;
+        addBatchFile(files, inputPath, answersPath);
+    }
+    fclose(manifest);
+    return true;
+}
+
+// A directory or a manifest, false if path is neither
+inline bool listBatchFiles(const char *path, std::vector<BatchFile> *files)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+    {
+        return false;
+    }
+    return S_ISDIR(info.st_mode) ? listBatchDirectory(path, files) : listBatchManifest(path, files);
+}
+
+// Calls process(worker, file) for every file not already failed, from
+// workerCount threads taking the largest remaining file each time. With a
+// single worker everything runs on the calling thread.
+template <typename Callback>
+void runBatchQueue(std::vector<BatchFile> &files, int workerCount, Callback process)
+{
+    std::vector<BatchFile *> queue;
+    for (BatchFile &file : files)
+    {
+        if (file.status == BATCH_PENDING)
+        {
+            queue.push_back(&file);
+        }
+    }
+    std::stable_sort(queue.begin(), queue.end(), [](const BatchFile *a, const BatchFile *b)
+                     { return a->size > b->size; });
+
+    std::atomic<u64> next{0};
+    auto work = [&](int worker)
+    {
+        for (u64 i = next++; i < queue.size(); i = next++)
+        {
+            process(worker, queue[i]);
+        }
+    };
+
+    if (workerCount <= 1)
+    {
+        work(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (int worker = 0; worker < workerCount; worker++)
+    {
+        threads.emplace_back(work, worker);
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+inline const char *getBatchStatusName(BatchStatus status)
+{
+    switch (status)
+    {
+    case BATCH_PENDING:
+        return "pending";
+    case BATCH_COMPUTED:
+        return "computed";
+    case BATCH_CORRECT:
+        return "correct";
+    case BATCH_MISMATCH:
+        return "MISMATCH";
+    case BATCH_FAILED:
+        return "FAILED";
+    }
+    return "unknown";
+}
+
+// Returns false if any file failed or didn't match its answers
+inline bool printBatchReport(const std::vector<BatchFile> &files, int workerCount, u64 wallNanoseconds)
+{
+    u64 bytes = 0;
+    u64 pairs = 0;
+    u64 busyNanoseconds = 0;
+    int statusCounts[BATCH_FAILED + 1] = {};
+    printf("%-40s %10s %12s %24s %10s %12s  %s\n", "file", "MB", "pairs", "average", "MB/s", "max ULP", "status");
+    for (const BatchFile &file : files)
+    {
+        const char *name = strrchr(file.input.c_str(), '/');
+        name = name ? name + 1 : file.input.c_str();
+        f64 megabytes = file.size / (1024.0 * 1024.0);
+        f64 seconds = file.nanoseconds / 1e9;
+        printf("%-40s %10.2f %12llu %24.14f %10.1f %12llu  %s", name, megabytes, (unsigned long long)file.count,
+               file.averageDistance, seconds > 0 ? megabytes / seconds : 0.0, (unsigned long long)file.maxUlp,
+               getBatchStatusName(file.status));
+        if (file.status == BATCH_MISMATCH && file.mismatches > 0)
+        {
+            printf(" (%llu values)", (unsigned long long)file.mismatches);
+        }
+        else if (file.status == BATCH_FAILED && !file.error.empty())
+        {
+            printf(" (%s)", file.error.c_str());
+        }
+        printf("\n");
+
+        statusCounts[file.status]++;
+        if (file.status != BATCH_FAILED)
+        {
+            bytes += file.size;
+            pairs += file.count;
+            busyNanoseconds += file.nanoseconds;
+        }
+    }
+
+    f64 megabytes = bytes / (1024.0 * 1024.0);
+    f64 seconds = wallNanoseconds / 1e9;
+    printf("\n%zu files, %llu pairs, %.2f MB in %.3f s on %d workers: %.1f MB/s, workers busy %.0f%% of the time\n",
+           files.size(), (unsigned long long)pairs, megabytes, seconds, workerCount, seconds > 0 ? megabytes / seconds : 0.0,
+           wallNanoseconds > 0 ? 100.0 * busyNanoseconds / ((f64)wallNanoseconds * workerCount) : 0.0);
+    printf("%d correct, %d computed without answers, %d mismatched, %d failed\n", statusCounts[BATCH_CORRECT],
+           statusCounts[BATCH_COMPUTED], statusCounts[BATCH_MISMATCH], statusCounts[BATCH_FAILED]);
+    return statusCounts[BATCH_MISMATCH] == 0 && statusCounts[BATCH_FAILED] == 0;
+}
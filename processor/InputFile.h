@@ -0,0 +1,222 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Arena.h"
+#include "profiler/profiler.h"
+
+typedef uint64_t u64;
+
+// Every loaded buffer is followed by this many zero bytes, so the parser can
+// read one token past the end (and SIMD code one block past it) without checks.
+static const u64 inputPadding = 64;
+
+struct LoadOptions
+{
+    enum Mode
+    {
+        // read() into a buffer taken from the document arena
+        READ,
+        // read-only private mapping of the file, no copy from the page cache
+        MMAP,
+    } mode = READ;
+
+    // fault every page in up front (MAP_POPULATE) instead of during parsing
+    bool populate = false;
+    // ask for 2MB pages: transparent huge pages for the mapping, or a huge page
+    // backed buffer in READ mode
+    bool hugePages = false;
+};
+
+struct InputFile
+{
+    const char *data = NULL;
+    u64 size = 0;
+    // set when data has to be munmap'ed instead of living in an arena
+    void *mapping = NULL;
+    u64 mappingSize = 0;
+};
+
+static const u64 hugePageSize = 2 * 1024 * 1024;
+
+u64 getPageSize()
+{
+    return (u64)sysconf(_SC_PAGESIZE);
+}
+
+u64 alignToPage(u64 size, u64 pageSize)
+{
+    return (size + pageSize - 1) & ~(pageSize - 1);
+}
+
+void readFully(int fd, char *buffer, u64 size)
+{
+    // read() transfers at most ~2GB per call on Linux
+    u64 total = 0;
+    while (total < size)
+    {
+        ssize_t bytesRead = read(fd, buffer + total, size - total);
+        if (bytesRead <= 0)
+        {
+            throw std::runtime_error("Failed to read input file.");
+        }
+        total += bytesRead;
+    }
+}
+
+void *mapAnonymous(u64 size, bool hugePages)
+{
+    void *mapping = MAP_FAILED;
+    if (hugePages)
+    {
+#ifdef MAP_HUGETLB
+        // explicit huge pages only work when some are reserved, fall back to THP
+        mapping = mmap(NULL, alignToPage(size, hugePageSize), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping != MAP_FAILED)
+        {
+            return mapping;
+        }
+#endif
+    }
+
+    mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map memory.");
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugePages)
+    {
+        madvise(mapping, size, MADV_HUGEPAGE);
+    }
+#endif
+    return mapping;
+}
+
+void mapInputFile(int fd, InputFile *file, const LoadOptions &options)
+{
+    u64 pageSize = getPageSize();
+    u64 fileMappingSize = alignToPage(file->size, pageSize);
+
+    // reserve the file pages plus a zeroed page for the padding, then put the
+    // file over the start of the reservation
+    file->mappingSize = fileMappingSize + alignToPage(inputPadding, pageSize);
+    file->mapping = mmap(NULL, file->mappingSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (file->mapping == MAP_FAILED)
+    {
+        file->mapping = NULL;
+        throw std::runtime_error("Failed to map input file.");
+    }
+
+    int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+    if (options.populate)
+    {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    if (mmap(file->mapping, fileMappingSize, PROT_READ, flags, fd, 0) == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map input file.");
+    }
+
+    madvise(file->mapping, fileMappingSize, MADV_SEQUENTIAL);
+    if (options.populate)
+    {
+        madvise(file->mapping, fileMappingSize, MADV_WILLNEED);
+    }
+#ifdef MADV_HUGEPAGE
+    if (options.hugePages)
+    {
+        madvise(file->mapping, fileMappingSize, MADV_HUGEPAGE);
+    }
+#endif
+
+    file->data = (const char *)file->mapping;
+}
+
+void readInputFile(int fd, InputFile *file, const LoadOptions &options, Arena *arena)
+{
+    char *buffer;
+    if (options.hugePages)
+    {
+        file->mappingSize = file->size + inputPadding;
+        file->mapping = mapAnonymous(file->mappingSize, true);
+        buffer = (char *)file->mapping;
+    }
+    else
+    {
+        buffer = arena->allocateArray<char>(file->size + inputPadding);
+    }
+
+    if (options.populate)
+    {
+        // touch every page before the read so the copy itself doesn't fault
+        u64 pageSize = getPageSize();
+        for (u64 i = 0; i < file->size; i += pageSize)
+        {
+            buffer[i] = 0;
+        }
+    }
+
+    readFully(fd, buffer, file->size);
+    memset(buffer + file->size, 0, inputPadding);
+    file->data = buffer;
+}
+
+void closeInputFile(InputFile *file)
+{
+    if (file->mapping)
+    {
+        munmap(file->mapping, file->mappingSize);
+    }
+    *file = InputFile();
+}
+
+// Buffers that don't need unmapping are taken from the arena and go away with it
+void openInputFile(const char *fileName, InputFile *file, const LoadOptions &options, Arena *arena)
+{
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open input file.");
+    }
+
+    try
+    {
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            throw std::runtime_error("Failed to stat input file.");
+        }
+        file->size = (u64)info.st_size;
+        if (file->size == 0)
+        {
+            throw std::runtime_error("Input file is empty.");
+        }
+        TIME_BANDWIDTH("openInputFile", file->size);
+
+        if (options.mode == LoadOptions::MMAP)
+        {
+            mapInputFile(fd, file, options);
+        }
+        else
+        {
+            readInputFile(fd, file, options, arena);
+        }
+    }
+    catch (...)
+    {
+        close(fd);
+        closeInputFile(file);
+        throw;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+}
@@ -0,0 +1,684 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "parser.h"
+
+// Flat alternative to the Value tree: the whole document is one array of
+// 64-bit words in document order, written by a single linear pass. The top
+// byte of a word is its type, the rest its payload:
+//   { [        index of the matching end word in the low 32 bits, element
+//              count in the next 24 (saturated, counted again past that)
+//   } ]        index of the matching begin word
+//   "          length, the next word is a pointer to the bytes
+//   d          nothing, the next word holds the bits of the f64
+//   t f n      true, false and null
+//   D S        lazy number and string: the next word points to the text as it
+//              is in the input, decoded each time it is read
+// Object members are a string word pair for the key followed by the value, so
+// a container skips to its end in one step and nodes cost 8 or 16 bytes.
+enum TapeType
+{
+    TAPE_OBJECT = '{',
+    TAPE_OBJECT_END = '}',
+    TAPE_ARRAY = '[',
+    TAPE_ARRAY_END = ']',
+    TAPE_STRING = '"',
+    TAPE_NUMBER = 'd',
+    TAPE_TRUE = 't',
+    TAPE_FALSE = 'f',
+    TAPE_NULL = 'n',
+    TAPE_RAW_NUMBER = 'D',
+    TAPE_RAW_STRING = 'S',
+};
+
+static const u64 tapePayloadMask = ((u64)1 << 56) - 1;
+static const u64 tapeMaxIndex = 0xFFFFFFFF;
+static const u64 tapeCountSaturated = 0xFFFFFF;
+
+inline u64 makeTapeWord(TapeType type, u64 payload)
+{
+    return ((u64)type << 56) | payload;
+}
+
+inline TapeType getTapeType(u64 word)
+{
+    return (TapeType)(word >> 56);
+}
+
+inline u64 getTapePayload(u64 word)
+{
+    return word & tapePayloadMask;
+}
+
+inline u64 getTapeEnd(u64 word)
+{
+    return word & tapeMaxIndex;
+}
+
+// Index of whatever follows the value at index
+inline u64 getNextTapeIndex(const u64 *tape, u64 index)
+{
+    switch (getTapeType(tape[index]))
+    {
+    case TAPE_OBJECT:
+    case TAPE_ARRAY:
+        return getTapeEnd(tape[index]) + 1;
+    case TAPE_STRING:
+    case TAPE_NUMBER:
+    case TAPE_RAW_NUMBER:
+    case TAPE_RAW_STRING:
+        return index + 2;
+    default:
+        return index + 1;
+    }
+}
+
+// Raw strings with escape sequences are unescaped into arena
+inline String getTapeString(const u64 *tape, u64 index, Arena *arena)
+{
+    String string;
+    string.length = getTapePayload(tape[index]);
+    string.data = (const char *)(uintptr_t)tape[index + 1];
+    if (getTapeType(tape[index]) == TAPE_RAW_STRING && memchr(string.data, '\\', string.length))
+    {
+        ParseStatus status = unescapeString(string.data, string.length, arena, &string);
+        if (status != PARSE_OK)
+        {
+            throw std::runtime_error(getParseStatusMessage(status));
+        }
+    }
+    return string;
+}
+
+inline f64 getTapeNumber(const u64 *tape, u64 index)
+{
+    f64 number;
+    if (getTapeType(tape[index]) == TAPE_RAW_NUMBER)
+    {
+        // the lazy parse only found where the number starts, the whole
+        // validation of getNumber happens here
+        const char *end = parseNumber((const char *)(uintptr_t)tape[index + 1], &number);
+        if (!end || !(*end == ',' || *end == ']' || *end == '}' || *end == ' ' || *end == '\n' || *end == '\t' || *end == '\r' || *end == '\0'))
+        {
+            throw std::runtime_error("Invalid number");
+        }
+        return number;
+    }
+    memcpy(&number, &tape[index + 1], sizeof(f64));
+    return number;
+}
+
+struct TapeIterator;
+
+// View of one value of a tape, valid as long as the tape isn't parsed again.
+// Indexing walks the siblings, iterate over big arrays instead.
+struct TapeValue
+{
+    const u64 *tape;
+    u64 index;
+    // where lazy strings with escape sequences get unescaped
+    Arena *arena = NULL;
+
+    Value::Type getType() const
+    {
+        switch (getTapeType(tape[index]))
+        {
+        case TAPE_OBJECT:
+            return Value::OBJECT;
+        case TAPE_ARRAY:
+            return Value::ARRAY;
+        case TAPE_STRING:
+        case TAPE_RAW_STRING:
+            return Value::STRING;
+        case TAPE_NUMBER:
+        case TAPE_RAW_NUMBER:
+            return Value::NUMBER;
+        case TAPE_TRUE:
+        case TAPE_FALSE:
+            return Value::BOOLEAN;
+        default:
+            return Value::NULL_VALUE;
+        }
+    }
+
+    size_t size() const
+    {
+        TapeType type = getTapeType(tape[index]);
+        if (type != TAPE_OBJECT && type != TAPE_ARRAY)
+        {
+            throw std::runtime_error("Not an array or object");
+        }
+
+        u64 count = getTapePayload(tape[index]) >> 32;
+        if (count < tapeCountSaturated)
+        {
+            return count;
+        }
+
+        u64 end = getTapeEnd(tape[index]);
+        count = 0;
+        for (u64 i = index + 1; i < end; i = getNextTapeIndex(tape, i))
+        {
+            if (type == TAPE_OBJECT)
+            {
+                i += 2;
+            }
+            count++;
+        }
+        return count;
+    }
+
+    TapeValue operator[](int position) const
+    {
+        TapeType type = getTapeType(tape[index]);
+        if (type != TAPE_OBJECT && type != TAPE_ARRAY)
+        {
+            throw std::runtime_error("Not an array or object");
+        }
+
+        u64 end = getTapeEnd(tape[index]);
+        u64 i = index + 1;
+        for (int skipped = 0; i < end; skipped++)
+        {
+            if (type == TAPE_OBJECT)
+            {
+                i += 2;
+            }
+            if (skipped == position)
+            {
+                return TapeValue{tape, i, arena};
+            }
+            i = getNextTapeIndex(tape, i);
+        }
+        throw std::out_of_range("Index out of bounds");
+    }
+
+    TapeValue operator[](const char *name) const
+    {
+        if (getTapeType(tape[index]) != TAPE_OBJECT)
+        {
+            throw std::runtime_error("Not an object");
+        }
+
+        u64 length = strlen(name);
+        u64 end = getTapeEnd(tape[index]);
+        for (u64 i = index + 1; i < end; i = getNextTapeIndex(tape, i + 2))
+        {
+            if (getTapeString(tape, i, arena).equals(name, length))
+            {
+                return TapeValue{tape, i + 2, arena};
+            }
+        }
+        throw std::runtime_error("No such member: \"" + std::string(name) + "\"");
+    }
+
+    f64 getNumber() const
+    {
+        TapeType type = getTapeType(tape[index]);
+        if (type != TAPE_NUMBER && type != TAPE_RAW_NUMBER)
+        {
+            throw std::runtime_error("Not a number");
+        }
+        return getTapeNumber(tape, index);
+    }
+
+    String getString() const
+    {
+        TapeType type = getTapeType(tape[index]);
+        if (type != TAPE_STRING && type != TAPE_RAW_STRING)
+        {
+            throw std::runtime_error("Not a string");
+        }
+        return getTapeString(tape, index, arena);
+    }
+
+    bool getBoolean() const
+    {
+        TapeType type = getTapeType(tape[index]);
+        if (type != TAPE_TRUE && type != TAPE_FALSE)
+        {
+            throw std::runtime_error("Not a boolean");
+        }
+        return type == TAPE_TRUE;
+    }
+
+    bool isNull() const
+    {
+        return getTapeType(tape[index]) == TAPE_NULL;
+    }
+
+    TapeIterator begin() const;
+    TapeIterator end() const;
+};
+
+// Walks the elements of an array in order
+struct TapeIterator
+{
+    const u64 *tape;
+    u64 index;
+    Arena *arena;
+
+    TapeValue operator*() const
+    {
+        return TapeValue{tape, index, arena};
+    }
+
+    TapeIterator &operator++()
+    {
+        index = getNextTapeIndex(tape, index);
+        return *this;
+    }
+
+    bool operator!=(const TapeIterator &other) const
+    {
+        return index != other.index;
+    }
+};
+
+inline TapeIterator TapeValue::begin() const
+{
+    if (getTapeType(tape[index]) != TAPE_ARRAY)
+    {
+        throw std::runtime_error("Not an array");
+    }
+    return TapeIterator{tape, index + 1, arena};
+}
+
+inline TapeIterator TapeValue::end() const
+{
+    if (getTapeType(tape[index]) != TAPE_ARRAY)
+    {
+        throw std::runtime_error("Not an array");
+    }
+    return TapeIterator{tape, getTapeEnd(tape[index]), arena};
+}
+
+void appendTapeValue(Parser *parser, ArrayList<u64> *tape, bool lazy);
+
+void appendTapeString(ArrayList<u64> *tape, String string, TapeType type = TAPE_STRING)
+{
+    tape->add(makeTapeWord(type, string.length));
+    tape->add((u64)(uintptr_t)string.data);
+}
+
+// Patches the begin word once the end of the container is known
+void closeTapeContainer(Parser *parser, ArrayList<u64> *tape, u64 begin, u64 count, TapeType beginType, TapeType endType)
+{
+    u64 end = tape->getSize();
+    if (end > tapeMaxIndex)
+    {
+        failParse(parser, PARSE_DOCUMENT_TOO_LARGE);
+        return;
+    }
+    if (count > tapeCountSaturated)
+    {
+        count = tapeCountSaturated;
+    }
+    tape->add(makeTapeWord(endType, begin));
+    (*tape)[begin] = makeTapeWord(beginType, end | (count << 32));
+}
+
+void appendTapeObject(Parser *parser, ArrayList<u64> *tape, bool lazy)
+{
+    u64 begin = tape->getSize();
+    tape->add(0);
+    u64 count = 0;
+
+    escapeWhitespaces(parser);
+    if (peak(parser) == '}')
+    {
+        next(parser);
+        closeTapeContainer(parser, tape, begin, count, TAPE_OBJECT, TAPE_OBJECT_END);
+        return;
+    }
+
+    char c = ',';
+    while (c == ',')
+    {
+        escapeWhitespaces(parser);
+        if (peak(parser) != '"')
+        {
+            failParse(parser, PARSE_EXPECTED_KEY);
+            return;
+        }
+        next(parser);
+        appendTapeString(tape, getString(parser));
+
+        escapeWhitespaces(parser);
+        if (peak(parser) != ':')
+        {
+            failParse(parser, PARSE_EXPECTED_COLON);
+            return;
+        }
+        next(parser);
+        escapeWhitespaces(parser);
+        appendTapeValue(parser, tape, lazy);
+        escapeWhitespaces(parser);
+        c = next(parser);
+        count++;
+    }
+
+    if (c != '}')
+    {
+        failParse(parser, PARSE_EXPECTED_OBJECT_END, parser->current - 1);
+        return;
+    }
+    closeTapeContainer(parser, tape, begin, count, TAPE_OBJECT, TAPE_OBJECT_END);
+}
+
+void appendTapeArray(Parser *parser, ArrayList<u64> *tape, bool lazy)
+{
+    u64 begin = tape->getSize();
+    tape->add(0);
+    u64 count = 0;
+
+    escapeWhitespaces(parser);
+    if (peak(parser) == ']')
+    {
+        next(parser);
+        closeTapeContainer(parser, tape, begin, count, TAPE_ARRAY, TAPE_ARRAY_END);
+        return;
+    }
+
+    char c = ',';
+    while (c == ',')
+    {
+        escapeWhitespaces(parser);
+        appendTapeValue(parser, tape, lazy);
+        escapeWhitespaces(parser);
+        c = next(parser);
+        count++;
+    }
+
+    if (c != ']')
+    {
+        failParse(parser, PARSE_EXPECTED_ARRAY_END, parser->current - 1);
+        return;
+    }
+    closeTapeContainer(parser, tape, begin, count, TAPE_ARRAY, TAPE_ARRAY_END);
+}
+
+// Same grammar as getValue. Lazy parses only check the structure: numbers are
+// skipped to the next structural and strings are kept escaped, both are
+// decoded if and when they are read. Keys are always decoded, lookups need them.
+void appendTapeValue(Parser *parser, ArrayList<u64> *tape, bool lazy)
+{
+    char c = next(parser);
+    switch (c)
+    {
+    case '{':
+        appendTapeObject(parser, tape, lazy);
+        break;
+    case '[':
+        appendTapeArray(parser, tape, lazy);
+        break;
+    case '"':
+    {
+        String string = lazy ? getRawString(parser) : getString(parser);
+        if (string == "true")
+        {
+            tape->add(makeTapeWord(TAPE_TRUE, 0));
+        }
+        else if (string == "false")
+        {
+            tape->add(makeTapeWord(TAPE_FALSE, 0));
+        }
+        else if (string == "null")
+        {
+            tape->add(makeTapeWord(TAPE_NULL, 0));
+        }
+        else
+        {
+            appendTapeString(tape, string, lazy ? TAPE_RAW_STRING : TAPE_STRING);
+        }
+        break;
+    }
+    case 't':
+    case 'f':
+        if (getLiteral(parser, c == 't' ? "true" : "false"))
+        {
+            tape->add(makeTapeWord(c == 't' ? TAPE_TRUE : TAPE_FALSE, 0));
+        }
+        break;
+    case 'n':
+        if (getLiteral(parser, "null"))
+        {
+            tape->add(makeTapeWord(TAPE_NULL, 0));
+        }
+        break;
+    default:
+        if (lazy && isNumberStart(c))
+        {
+            tape->add(makeTapeWord(TAPE_RAW_NUMBER, 0));
+            tape->add((u64)(uintptr_t)(parser->buffer + parser->current - 1));
+            parser->current = nextStructural(parser->index, parser->current);
+        }
+        else if (isNumberStart(c))
+        {
+            f64 number = getNumber(parser);
+            u64 bits;
+            memcpy(&bits, &number, sizeof(f64));
+            tape->add(makeTapeWord(TAPE_NUMBER, 0));
+            tape->add(bits);
+        }
+        else
+        {
+            failParse(parser, PARSE_UNEXPECTED_CHARACTER, parser->current - 1);
+        }
+        break;
+    }
+}
+
+// Returns the index after the value
+u64 writeTapeValue(JsonWriter *writer, const u64 *tape, u64 index, Arena *arena)
+{
+    switch (getTapeType(tape[index]))
+    {
+    case TAPE_OBJECT:
+    {
+        u64 end = getTapeEnd(tape[index]);
+        writeObjectBegin(writer);
+        u64 i = index + 1;
+        while (i < end)
+        {
+            String name = getTapeString(tape, i, arena);
+            writeKey(writer, name.data, name.length);
+            i = writeTapeValue(writer, tape, i + 2, arena);
+        }
+        writeObjectEnd(writer);
+        return end + 1;
+    }
+    case TAPE_ARRAY:
+    {
+        u64 end = getTapeEnd(tape[index]);
+        writeArrayBegin(writer);
+        u64 i = index + 1;
+        while (i < end)
+        {
+            i = writeTapeValue(writer, tape, i, arena);
+        }
+        writeArrayEnd(writer);
+        return end + 1;
+    }
+    case TAPE_STRING:
+    case TAPE_RAW_STRING:
+    {
+        String string = getTapeString(tape, index, arena);
+        writeString(writer, string.data, string.length);
+        return index + 2;
+    }
+    case TAPE_NUMBER:
+    case TAPE_RAW_NUMBER:
+        writeNumber(writer, getTapeNumber(tape, index));
+        return index + 2;
+    case TAPE_TRUE:
+        writeBoolean(writer, true);
+        return index + 1;
+    case TAPE_FALSE:
+        writeBoolean(writer, false);
+        return index + 1;
+    default:
+        writeNull(writer);
+        return index + 1;
+    }
+}
+
+// Tape counterpart of Json. The words grow on the heap, where realloc can
+// move them cheaply; unescaped strings and a read input live in the arena.
+struct JsonTape
+{
+    ArrayList<u64> words;
+    Arena arena;
+    InputFile input;
+
+    JsonTape()
+    {
+        words.add(makeTapeWord(TAPE_NULL, 0));
+    }
+
+    JsonTape(JsonTape &&other) : words(std::move(other.words)), arena(std::move(other.arena))
+    {
+        input = other.input;
+        other.input = InputFile();
+        other.words.add(makeTapeWord(TAPE_NULL, 0));
+    }
+
+    JsonTape &operator=(JsonTape &&other)
+    {
+        closeInputFile(&input);
+        words = std::move(other.words);
+        arena = std::move(other.arena);
+        input = other.input;
+        other.input = InputFile();
+        other.words.add(makeTapeWord(TAPE_NULL, 0));
+        return *this;
+    }
+
+    ~JsonTape()
+    {
+        closeInputFile(&input);
+    }
+
+    JsonTape &operator=(const JsonTape &other) = delete;
+    JsonTape(const JsonTape &other) = delete;
+
+    void clear()
+    {
+        closeInputFile(&input);
+        arena.reset();
+        words.clear();
+        words.add(makeTapeWord(TAPE_NULL, 0));
+    }
+
+    TapeValue root()
+    {
+        return TapeValue{words.begin(), 0, &arena};
+    }
+
+    size_t size()
+    {
+        return root().size();
+    }
+
+    TapeValue operator[](int index)
+    {
+        return root()[index];
+    }
+
+    TapeValue operator[](const char *name)
+    {
+        return root()[name];
+    }
+
+    void write(JsonWriter *writer)
+    {
+        writeTapeValue(writer, words.begin(), 0, &arena);
+    }
+
+    char *print(bool pretty = true)
+    {
+        JsonWriter writer = JsonWriter();
+        initJsonWriter(&writer, pretty);
+        write(&writer);
+        char *text = arena.allocateArray<char>(writer.size + 1);
+        memcpy(text, writer.buffer, writer.size);
+        text[writer.size] = '\0';
+        return text;
+    }
+
+    void print(int fd, bool pretty = true)
+    {
+        JsonWriter writer = JsonWriter();
+        initJsonWriter(&writer, pretty, fd);
+        write(&writer);
+        flushJsonWriter(&writer);
+    }
+};
+
+// With lazy set, numbers and strings are only decoded when read, see
+// appendTapeValue. Never throws: on error the tape holds a single null and the
+// result says what went wrong and where.
+ParseResult tryParse(const char *inputFileName, JsonTape &tape, const LoadOptions &options = LoadOptions(), bool lazy = false) noexcept
+{
+    tape.clear();
+
+    ParseStatus status;
+    u64 offset = 0;
+    try
+    {
+        openInputFile(inputFileName, &tape.input, options, &tape.arena);
+
+        TIME_BANDWIDTH("parseTape", tape.input.size);
+        // grown on demand: the words end up in one heap block, which realloc
+        // extends in place or remaps once it's large, so doubling doesn't copy
+        // much and the tape never holds more than twice what it needs
+        tape.words.clear();
+        StructuralIndex index;
+        Parser parser;
+        initParser(&parser, tape.input.data, tape.input.size, &index, &tape.arena);
+        escapeWhitespaces(&parser);
+        appendTapeValue(&parser, &tape.words, lazy);
+        escapeWhitespaces(&parser);
+        if (parser.status == PARSE_OK && parser.current != parser.size)
+        {
+            failParse(&parser, PARSE_TRAILING_CHARACTERS);
+        }
+        status = parser.status;
+        offset = parser.errorOffset;
+    }
+    catch (const std::bad_alloc &)
+    {
+        status = PARSE_OUT_OF_MEMORY;
+    }
+    catch (const std::exception &)
+    {
+        status = PARSE_IO_ERROR;
+    }
+
+    if (status != PARSE_OK)
+    {
+        tape.words.clear();
+        tape.words.add(makeTapeWord(TAPE_NULL, 0));
+    }
+    return makeParseResult(status, status == PARSE_IO_ERROR ? NULL : tape.input.data, offset);
+}
+
+// Throwing version of tryParse(), the message has the position of the error
+void parse(const char *inputFileName, JsonTape &tape, const LoadOptions &options = LoadOptions(), bool lazy = false)
+{
+    ParseResult result = tryParse(inputFileName, tape, options, lazy);
+    if (!result.ok())
+    {
+        char message[128];
+        formatParseResult(result, message, sizeof(message));
+        throw std::runtime_error(message);
+    }
+}
+
+JsonTape parseTape(const char *inputFileName, const LoadOptions &options = LoadOptions(), bool lazy = false)
+{
+    JsonTape tape = JsonTape();
+    parse(inputFileName, tape, options, lazy);
+    return tape;
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <charconv>
+#include <new>
+#include <stdexcept>
+#include <unistd.h>
+
+typedef double f64;
+typedef uint64_t u64;
+
+// Streaming JSON serializer: values are appended to a growable buffer, or
+// flushed to a file descriptor whenever the buffer fills up, so writing a
+// document is linear in its size and memory stays bounded with a descriptor.
+// Commas and indentation are derived from two flags, no stack is kept.
+struct JsonWriter
+{
+    char *buffer = NULL;
+    u64 size = 0;
+    u64 capacity = 0;
+    // -1 to keep everything in buffer
+    int fd = -1;
+
+    // 4 spaces per level, one element per line
+    bool pretty = false;
+    // compact output still puts the elements of containers opened below this
+    // depth on their own lines, 2 gives one record per line in {"pairs":[...]}
+    int breakDepth = 0;
+
+    int depth = 0;
+    // an element was already written in the current container
+    bool needsSeparator = false;
+    // the next value belongs to the key just written
+    bool afterKey = false;
+
+    JsonWriter() = default;
+    JsonWriter(const JsonWriter &other) = delete;
+    JsonWriter &operator=(const JsonWriter &other) = delete;
+
+    ~JsonWriter()
+    {
+        free(buffer);
+    }
+};
+
+static const u64 jsonWriterFlushSize = 1 << 20;
+
+inline void initJsonWriter(JsonWriter *writer, bool pretty, int fd = -1)
+{
+    writer->size = 0;
+    writer->fd = fd;
+    writer->pretty = pretty;
+    writer->breakDepth = 0;
+    writer->depth = 0;
+    writer->needsSeparator = false;
+    writer->afterKey = false;
+}
+
+inline void flushJsonWriter(JsonWriter *writer)
+{
+    if (writer->fd < 0)
+    {
+        return;
+    }
+    u64 written = 0;
+    while (written < writer->size)
+    {
+        ssize_t result = write(writer->fd, writer->buffer + written, writer->size - written);
+        if (result <= 0)
+        {
+            throw std::runtime_error("Failed to write JSON output.");
+        }
+        written += result;
+    }
+    writer->size = 0;
+}
+
+// Room for at least count more bytes
+inline char *reserveJsonOutput(JsonWriter *writer, u64 count)
+{
+    if (writer->size + count > writer->capacity)
+    {
+        if (writer->fd >= 0)
+        {
+            flushJsonWriter(writer);
+        }
+        if (writer->size + count > writer->capacity)
+        {
+            u64 capacity = writer->capacity * 2;
+            if (capacity < writer->size + count)
+            {
+                capacity = writer->size + count;
+            }
+            if (capacity < jsonWriterFlushSize && writer->fd >= 0)
+            {
+                capacity = jsonWriterFlushSize;
+            }
+            if (capacity < 4096)
+            {
+                capacity = 4096;
+            }
+            char *buffer = (char *)realloc(writer->buffer, capacity);
+            if (!buffer)
+            {
+                throw std::bad_alloc();
+            }
+            writer->buffer = buffer;
+            writer->capacity = capacity;
+        }
+    }
+    return writer->buffer + writer->size;
+}
+
+inline void writeJsonBytes(JsonWriter *writer, const char *bytes, u64 count)
+{
+    memcpy(reserveJsonOutput(writer, count), bytes, count);
+    writer->size += count;
+}
+
+inline void writeJsonLineBreak(JsonWriter *writer, int depth)
+{
+    int indent = writer->pretty ? depth * 4 : 0;
+    char *out = reserveJsonOutput(writer, indent + 1);
+    *out++ = '\n';
+    memset(out, ' ', indent);
+    writer->size += indent + 1;
+}
+
+// Separator and line break in front of a key, or of a value in an array
+inline void beginJsonElement(JsonWriter *writer)
+{
+    if (writer->afterKey)
+    {
+        writer->afterKey = false;
+        return;
+    }
+    if (writer->needsSeparator)
+    {
+        writeJsonBytes(writer, ",", 1);
+    }
+    if (writer->depth > 0 && (writer->pretty || writer->depth < writer->breakDepth))
+    {
+        writeJsonLineBreak(writer, writer->depth);
+    }
+    writer->needsSeparator = true;
+}
+
+inline void writeJsonContainerBegin(JsonWriter *writer, char c)
+{
+    beginJsonElement(writer);
+    writeJsonBytes(writer, &c, 1);
+    writer->depth++;
+    writer->needsSeparator = false;
+}
+
+inline void writeJsonContainerEnd(JsonWriter *writer, char c)
+{
+    // empty containers stay on one line
+    bool lineBreak = writer->needsSeparator && (writer->pretty || writer->depth < writer->breakDepth);
+    writer->depth--;
+    if (lineBreak)
+    {
+        writeJsonLineBreak(writer, writer->depth);
+    }
+    writeJsonBytes(writer, &c, 1);
+    writer->needsSeparator = true;
+}
+
+inline void writeObjectBegin(JsonWriter *writer)
+{
+    writeJsonContainerBegin(writer, '{');
+}
+
+inline void writeObjectEnd(JsonWriter *writer)
+{
+    writeJsonContainerEnd(writer, '}');
+}
+
+inline void writeArrayBegin(JsonWriter *writer)
+{
+    writeJsonContainerBegin(writer, '[');
+}
+
+inline void writeArrayEnd(JsonWriter *writer)
+{
+    writeJsonContainerEnd(writer, ']');
+}
+
+// Quoted and escaped, runs without anything to escape are copied at once
+inline void writeJsonStringContent(JsonWriter *writer, const char *data, u64 length)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    writeJsonBytes(writer, "\"", 1);
+    u64 runStart = 0;
+    for (u64 i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)data[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        writeJsonBytes(writer, data + runStart, i - runStart);
+        runStart = i + 1;
+
+        char escaped[6] = {'\\', (char)c, 0, 0, 0, 0};
+        u64 escapedLength = 2;
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            break;
+        case '\n':
+            escaped[1] = 'n';
+            break;
+        case '\t':
+            escaped[1] = 't';
+            break;
+        case '\r':
+            escaped[1] = 'r';
+            break;
+        case '\b':
+            escaped[1] = 'b';
+            break;
+        case '\f':
+            escaped[1] = 'f';
+            break;
+        default:
+            escaped[1] = 'u';
+            escaped[2] = '0';
+            escaped[3] = '0';
+            escaped[4] = hexDigits[c >> 4];
+            escaped[5] = hexDigits[c & 0xF];
+            escapedLength = 6;
+            break;
+        }
+        writeJsonBytes(writer, escaped, escapedLength);
+    }
+    writeJsonBytes(writer, data + runStart, length - runStart);
+    writeJsonBytes(writer, "\"", 1);
+}
+
+inline void writeKey(JsonWriter *writer, const char *name, u64 length)
+{
+    beginJsonElement(writer);
+    writeJsonStringContent(writer, name, length);
+    writeJsonBytes(writer, writer->pretty ? ": " : ":", writer->pretty ? 2 : 1);
+    writer->afterKey = true;
+}
+
+inline void writeString(JsonWriter *writer, const char *data, u64 length)
+{
+    beginJsonElement(writer);
+    writeJsonStringContent(writer, data, length);
+}
+
+// Shortest text that parses back to the same double; JSON has no inf or NaN
+// so those are written as null
+inline void writeNumber(JsonWriter *writer, f64 number)
+{
+    beginJsonElement(writer);
+    if (number != number || number - number != 0)
+    {
+        writeJsonBytes(writer, "null", 4);
+        return;
+    }
+    char *out = reserveJsonOutput(writer, 32);
+    writer->size += std::to_chars(out, out + 32, number).ptr - out;
+}
+
+inline void writeBoolean(JsonWriter *writer, bool boolean)
+{
+    beginJsonElement(writer);
+    writeJsonBytes(writer, boolean ? "true" : "false", boolean ? 4 : 5);
+}
+
+inline void writeNull(JsonWriter *writer)
+{
+    beginJsonElement(writer);
+    writeJsonBytes(writer, "null", 4);
+}
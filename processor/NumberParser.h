@@ -0,0 +1,285 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <charconv>
+#include "PowersOfFive.h"
+
+typedef double f64;
+typedef uint64_t u64;
+typedef int64_t s64;
+
+// JSON number decoder, bit identical to std::from_chars:
+//  - digits are read 8 at a time with SWAR while they last
+//  - up to 19 significant digits fit the u64 mantissa exactly
+//  - mantissas up to 2^53 with |exponent| <= 22 are one exact multiply or
+//    divide (Clinger's fast path)
+//  - everything else goes through Eisel-Lemire with a 128 bit power of five,
+//    which rounds correctly unless the product is too close to a halfway point
+//  - those rare cases, and mantissas truncated to 19 digits whose rounding
+//    depends on the dropped digits, fall back to std::from_chars
+// Overflow gives +-inf and underflow +-0 like strtod, where from_chars reports
+// an error: 1e400 is valid JSON, just not a finite double.
+// The input must be readable 8 bytes past the number (InputFile padding).
+
+inline bool isEightDigits(u64 chunk)
+{
+    return ((chunk & 0xF0F0F0F0F0F0F0F0) | (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+
+// 8 ASCII digits, first digit in the low byte, to their value
+inline u64 getEightDigits(u64 chunk)
+{
+    const u64 mask = 0x000000FF000000FF;
+    const u64 multiplier1 = 100 + (1000000ULL << 32);
+    const u64 multiplier2 = 1 + (10000ULL << 32);
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10) + (chunk >> 8);
+    chunk = (((chunk & mask) * multiplier1) + (((chunk >> 16) & mask) * multiplier2)) >> 32;
+    return (uint32_t)chunk;
+}
+
+inline u64 loadEightBytes(const char *p)
+{
+    u64 chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+    return chunk;
+}
+
+inline const char *getDigits(const char *p, u64 *mantissa)
+{
+    u64 value = *mantissa;
+    while (isEightDigits(loadEightBytes(p)))
+    {
+        value = value * 100000000 + getEightDigits(loadEightBytes(p));
+        p += 8;
+    }
+    while ((unsigned char)(*p - '0') < 10)
+    {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    *mantissa = value;
+    return p;
+}
+
+// Eisel-Lemire: w * 10^q rounded to the nearest double, as raw bits without
+// the sign. Returns false when the fast computation can't decide.
+inline bool getEiselLemire(u64 w, s64 q, u64 *bits)
+{
+    if (w == 0 || q < smallestPowerOfFive)
+    {
+        *bits = 0;
+        return true;
+    }
+    if (q > largestPowerOfFive)
+    {
+        *bits = (u64)0x7FF << 52;
+        return true;
+    }
+
+    int leadingZeros = __builtin_clzll(w);
+    w <<= leadingZeros;
+
+    // 55 significant bits of w * 5^q, widened to the second word of the
+    // power when the first product alone is too close to call
+    int index = 2 * (int)(q - smallestPowerOfFive);
+    unsigned __int128 first = (unsigned __int128)w * powersOfFive[index];
+    u64 high = (u64)(first >> 64);
+    u64 low = (u64)first;
+    const u64 precisionMask = 0xFFFFFFFFFFFFFFFF >> 55;
+    if ((high & precisionMask) == precisionMask)
+    {
+        unsigned __int128 second = (unsigned __int128)w * powersOfFive[index + 1];
+        u64 secondHigh = (u64)(second >> 64);
+        low += secondHigh;
+        if (secondHigh > low)
+        {
+            high++;
+        }
+    }
+    if (low == 0xFFFFFFFFFFFFFFFF && (q < -27 || q > 55))
+    {
+        return false;
+    }
+
+    int upperBit = (int)(high >> 63);
+    int shift = upperBit + 64 - 52 - 3;
+    u64 mantissa = high >> shift;
+    // floor(log2(10^q)) + 63, then the binary exponent with its bias
+    s64 power2 = ((((152170 + 65536) * q) >> 16) + 63) + upperBit - leadingZeros + 1023;
+
+    if (power2 <= 0)
+    {
+        // subnormal
+        if (-power2 + 1 >= 64)
+        {
+            *bits = 0;
+            return true;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < ((u64)1 << 52) ? 0 : 1;
+        *bits = (mantissa & (((u64)1 << 52) - 1)) | ((u64)power2 << 52);
+        return true;
+    }
+
+    // exactly halfway between two doubles: round to even instead of up. Only
+    // possible when 5^q fits in 64 bits.
+    if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == high)
+    {
+        mantissa &= ~(u64)1;
+    }
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= ((u64)2 << 52))
+    {
+        mantissa = (u64)1 << 52;
+        power2++;
+    }
+    mantissa &= ~((u64)1 << 52);
+    if (power2 >= 0x7FF)
+    {
+        *bits = (u64)0x7FF << 52;
+        return true;
+    }
+    *bits = mantissa | ((u64)power2 << 52);
+    return true;
+}
+
+// Parses the JSON number starting at begin, returns its end, or NULL if
+// there is no valid number there
+inline const char *parseNumber(const char *begin, f64 *value)
+{
+    static const f64 powersOfTen[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char *p = begin;
+    bool negative = *p == '-';
+    p += negative;
+
+    const char *integerBegin = p;
+    u64 mantissa = 0;
+    p = getDigits(p, &mantissa);
+    const char *integerEnd = p;
+    s64 digitCount = integerEnd - integerBegin;
+    // JSON has no leading zeros: 0 can only be followed by '.', 'e' or the end
+    if (digitCount == 0 || (*integerBegin == '0' && digitCount > 1))
+    {
+        return NULL;
+    }
+
+    s64 exponent = 0;
+    const char *fractionBegin = NULL;
+    const char *fractionEnd = NULL;
+    if (*p == '.')
+    {
+        p++;
+        fractionBegin = p;
+        p = getDigits(p, &mantissa);
+        fractionEnd = p;
+        if (fractionEnd == fractionBegin)
+        {
+            return NULL;
+        }
+        exponent = fractionBegin - fractionEnd;
+        digitCount += fractionEnd - fractionBegin;
+    }
+
+    s64 explicitExponent = 0;
+    if (*p == 'e' || *p == 'E')
+    {
+        p++;
+        bool negativeExponent = *p == '-';
+        if (*p == '-' || *p == '+')
+        {
+            p++;
+        }
+        if ((unsigned char)(*p - '0') >= 10)
+        {
+            return NULL;
+        }
+        while ((unsigned char)(*p - '0') < 10)
+        {
+            // past this the result is 0 or inf anyway
+            if (explicitExponent < 0x10000000)
+            {
+                explicitExponent = explicitExponent * 10 + (*p - '0');
+            }
+            p++;
+        }
+        if (negativeExponent)
+        {
+            explicitExponent = -explicitExponent;
+        }
+        exponent += explicitExponent;
+    }
+    const char *end = p;
+
+    // leading zeros don't count; a mantissa of more than 19 digits wrapped
+    // around and is read again from its first 19 digits
+    bool truncated = false;
+    if (digitCount > 19)
+    {
+        for (const char *c = integerBegin; *c == '0' || *c == '.'; c++)
+        {
+            digitCount -= *c == '0';
+        }
+        if (digitCount > 19)
+        {
+            truncated = true;
+            const u64 minimum19Digits = 1000000000000000000;
+            mantissa = 0;
+            p = integerBegin;
+            while (mantissa < minimum19Digits && p != integerEnd)
+            {
+                mantissa = mantissa * 10 + (*p++ - '0');
+            }
+            if (mantissa >= minimum19Digits)
+            {
+                exponent = (integerEnd - p) + explicitExponent;
+            }
+            else
+            {
+                p = fractionBegin;
+                while (mantissa < minimum19Digits && p != fractionEnd)
+                {
+                    mantissa = mantissa * 10 + (*p++ - '0');
+                }
+                exponent = (fractionBegin - p) + explicitExponent;
+            }
+        }
+    }
+
+    if (!truncated && exponent >= -22 && exponent <= 22 && mantissa <= ((u64)1 << 53))
+    {
+        // both operands are exact doubles, so the one rounding is the right one
+        f64 result = (f64)mantissa;
+        result = exponent < 0 ? result / powersOfTen[-exponent] : result * powersOfTen[exponent];
+        *value = negative ? -result : result;
+        return end;
+    }
+
+    u64 bits;
+    bool decided = getEiselLemire(mantissa, exponent, &bits);
+    if (decided && truncated)
+    {
+        // the dropped digits only matter if they could change the rounding
+        u64 upperBits;
+        decided = getEiselLemire(mantissa + 1, exponent, &upperBits) && upperBits == bits;
+    }
+    if (!decided)
+    {
+        if (std::from_chars(begin, end, *value).ec != std::errc())
+        {
+            *value = strtod(begin, NULL);
+        }
+        return end;
+    }
+
+    bits |= (u64)negative << 63;
+    memcpy(value, &bits, sizeof(bits));
+    return end;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef uint64_t u64;
+
+// Why a parse stopped. The parsing code returns these instead of throwing,
+// the throwing entry points turn them into exceptions.
+enum ParseStatus
+{
+    PARSE_OK,
+    PARSE_UNEXPECTED_CHARACTER,
+    PARSE_EXPECTED_KEY,
+    PARSE_EXPECTED_COLON,
+    PARSE_EXPECTED_OBJECT_END,
+    PARSE_EXPECTED_ARRAY_END,
+    PARSE_UNTERMINATED_STRING,
+    PARSE_INVALID_ESCAPE,
+    PARSE_INVALID_UNICODE_ESCAPE,
+    PARSE_INVALID_SURROGATE_PAIR,
+    PARSE_INVALID_NUMBER,
+    PARSE_TRAILING_CHARACTERS,
+    PARSE_UNEXPECTED_END,
+    PARSE_DOCUMENT_TOO_LARGE,
+    PARSE_IO_ERROR,
+    PARSE_OUT_OF_MEMORY,
+    // from the pairs decoders: valid JSON without the coordinates of a pair,
+    // and binary files that aren't the generator's
+    PARSE_MISSING_COORDINATES,
+    PARSE_INVALID_BINARY,
+    PARSE_CHECKSUM_MISMATCH,
+    // not an error: the input isn't in the shape a specialized decoder
+    // expects, the generic parser has to decide
+    PARSE_UNEXPECTED_SHAPE,
+};
+
+// Where the first error is: offset in bytes, line and column from 1, the
+// column in bytes. All zero when status is PARSE_OK, and for I/O errors.
+struct ParseResult
+{
+    ParseStatus status;
+    u64 offset;
+    u64 line;
+    u64 column;
+
+    bool ok() const
+    {
+        return status == PARSE_OK;
+    }
+};
+
+inline const char *getParseStatusMessage(ParseStatus status)
+{
+    switch (status)
+    {
+    case PARSE_OK:
+        return "No error";
+    case PARSE_UNEXPECTED_CHARACTER:
+        return "Unexpected character";
+    case PARSE_EXPECTED_KEY:
+        return "Expected '\"'";
+    case PARSE_EXPECTED_COLON:
+        return "Expected ':'";
+    case PARSE_EXPECTED_OBJECT_END:
+        return "Expected '}'";
+    case PARSE_EXPECTED_ARRAY_END:
+        return "Expected ']'";
+    case PARSE_UNTERMINATED_STRING:
+        return "Unterminated string";
+    case PARSE_INVALID_ESCAPE:
+        return "Invalid escape sequence";
+    case PARSE_INVALID_UNICODE_ESCAPE:
+        return "Invalid \\u escape";
+    case PARSE_INVALID_SURROGATE_PAIR:
+        return "Invalid surrogate pair";
+    case PARSE_INVALID_NUMBER:
+        return "Invalid number";
+    case PARSE_TRAILING_CHARACTERS:
+        return "Unexpected character after the document";
+    case PARSE_UNEXPECTED_END:
+        return "Unexpected end of input";
+    case PARSE_DOCUMENT_TOO_LARGE:
+        return "Document too large";
+    case PARSE_IO_ERROR:
+        return "Failed to read input file";
+    case PARSE_OUT_OF_MEMORY:
+        return "Out of memory";
+    case PARSE_MISSING_COORDINATES:
+        return "Pair without x0, y0, x1 and y1";
+    case PARSE_INVALID_BINARY:
+        return "Not a binary pairs file";
+    case PARSE_CHECKSUM_MISMATCH:
+        return "Binary pairs checksum mismatch";
+    case PARSE_UNEXPECTED_SHAPE:
+        return "Not in the generator's shape";
+    }
+    return "Unknown error";
+}
+
+// Only called once a parse failed, so the lines are counted then and not
+// while parsing
+inline ParseResult makeParseResult(ParseStatus status, const char *buffer, u64 offset)
+{
+    ParseResult result = ParseResult();
+    result.status = status;
+    if (status == PARSE_OK || !buffer)
+    {
+        return result;
+    }
+
+    result.offset = offset;
+    result.line = 1;
+    u64 lineStart = 0;
+    for (u64 i = 0; i < offset; i++)
+    {
+        if (buffer[i] == '\n')
+        {
+            result.line++;
+            lineStart = i + 1;
+        }
+    }
+    result.column = offset - lineStart + 1;
+    return result;
+}
+
+// "Expected '}' at line 3, column 14 (byte 52)"
+inline void formatParseResult(const ParseResult &result, char *text, u64 size)
+{
+    if (result.line == 0)
+    {
+        snprintf(text, size, "%s", getParseStatusMessage(result.status));
+        return;
+    }
+    snprintf(text, size, "%s at line %llu, column %llu (byte %llu)", getParseStatusMessage(result.status),
+             (unsigned long long)result.line, (unsigned long long)result.column, (unsigned long long)result.offset);
+}
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "parser.h"
+
+// Column extraction with JSON Pointer paths: "/pairs/*/x0" is the x0 member of
+// every element of the pairs member of the root. A segment is a member name
+// (~0 and ~1 stand for ~ and /), an array index when it's a number, or * for
+// any element or member. A query holds up to 64 paths, compiled into one mask
+// of paths per segment so a single walk tells for every value which paths it
+// is still on; the numbers found at the end of a path are appended to its
+// column. Non-number values at the end of a path are ignored.
+
+static const int queryMaxPaths = 64;
+static const int queryMaxSegments = 16;
+
+struct QueryName
+{
+    String name;
+    // array index the segment also stands for, UINT64_MAX if it's not a number
+    u64 index;
+    // paths that have this name at this segment
+    u64 mask;
+};
+
+struct QuerySegment
+{
+    u64 wildcardMask;
+    ArrayList<QueryName> names;
+};
+
+struct Query
+{
+    int pathCount;
+    // leafMasks[i]: paths made of exactly i segments
+    u64 leafMasks[queryMaxSegments + 1];
+    QuerySegment segments[queryMaxSegments];
+    // unescaped names
+    Arena arena;
+};
+
+// Caller provided output, count keeps counting past capacity so an undersized
+// column can be detected and the query run again
+struct QueryColumn
+{
+    f64 *values;
+    u64 capacity;
+    u64 count;
+};
+
+void initQueryColumn(QueryColumn *column, f64 *values, u64 capacity)
+{
+    column->values = values;
+    column->capacity = capacity;
+    column->count = 0;
+}
+
+void addQuerySegment(Query *query, int path, int segment, const char *begin, const char *end)
+{
+    u64 bit = (u64)1 << path;
+    QuerySegment *querySegment = &query->segments[segment];
+    if (end - begin == 1 && *begin == '*')
+    {
+        querySegment->wildcardMask |= bit;
+        return;
+    }
+
+    char *name = query->arena.allocateArray<char>(end - begin);
+    u64 length = 0;
+    bool isIndex = begin != end;
+    u64 index = 0;
+    for (const char *c = begin; c < end; c++)
+    {
+        char unescaped = *c;
+        if (*c == '~' && c + 1 < end && (c[1] == '0' || c[1] == '1'))
+        {
+            unescaped = *++c == '0' ? '~' : '/';
+        }
+        isIndex = isIndex && isDigit(unescaped) && length < 18;
+        index = index * 10 + (unescaped - '0');
+        name[length++] = unescaped;
+    }
+    // RFC 6901: "01" is a member name, only "0" may start with a zero
+    isIndex = isIndex && (length == 1 || name[0] != '0');
+
+    for (QueryName &queryName : querySegment->names)
+    {
+        if (queryName.name.equals(name, length))
+        {
+            queryName.mask |= bit;
+            return;
+        }
+    }
+    QueryName queryName;
+    queryName.name.data = name;
+    queryName.name.length = length;
+    queryName.index = isIndex ? index : UINT64_MAX;
+    queryName.mask = bit;
+    querySegment->names.add(queryName);
+}
+
+// Returns false if there are too many paths, a path is too deep or doesn't
+// start with '/' (the empty path is the root itself)
+bool compileQuery(Query *query, const char *const *paths, int pathCount)
+{
+    query->arena.reset();
+    query->pathCount = 0;
+    memset(query->leafMasks, 0, sizeof(query->leafMasks));
+    for (int i = 0; i < queryMaxSegments; i++)
+    {
+        query->segments[i].wildcardMask = 0;
+        query->segments[i].names.clear();
+    }
+    if (pathCount > queryMaxPaths)
+    {
+        return false;
+    }
+
+    for (int path = 0; path < pathCount; path++)
+    {
+        const char *c = paths[path];
+        int segment = 0;
+        if (*c != '\0' && *c != '/')
+        {
+            return false;
+        }
+        while (*c == '/')
+        {
+            if (segment == queryMaxSegments)
+            {
+                return false;
+            }
+            const char *begin = ++c;
+            while (*c != '\0' && *c != '/')
+            {
+                c++;
+            }
+            addQuerySegment(query, path, segment++, begin, c);
+        }
+        query->leafMasks[segment] |= (u64)1 << path;
+    }
+    query->pathCount = pathCount;
+    return true;
+}
+
+// Paths of mask that go on through the member called name, at this segment
+inline u64 matchQueryName(const Query *query, int segment, u64 mask, const char *name, u64 length)
+{
+    if (segment >= queryMaxSegments || !mask)
+    {
+        return 0;
+    }
+    const QuerySegment *querySegment = &query->segments[segment];
+    u64 matched = querySegment->wildcardMask;
+    for (const QueryName &queryName : querySegment->names)
+    {
+        if (queryName.name.equals(name, length))
+        {
+            matched |= queryName.mask;
+        }
+    }
+    return mask & matched;
+}
+
+inline u64 matchQueryIndex(const Query *query, int segment, u64 mask, u64 index)
+{
+    if (segment >= queryMaxSegments || !mask)
+    {
+        return 0;
+    }
+    const QuerySegment *querySegment = &query->segments[segment];
+    u64 matched = querySegment->wildcardMask;
+    for (const QueryName &queryName : querySegment->names)
+    {
+        if (queryName.index == index)
+        {
+            matched |= queryName.mask;
+        }
+    }
+    return mask & matched;
+}
+
+inline void addQueryNumber(const Query *query, int segment, u64 mask, f64 number, QueryColumn *columns)
+{
+    if (segment > queryMaxSegments)
+    {
+        return;
+    }
+    u64 leaves = mask & query->leafMasks[segment];
+    while (leaves)
+    {
+        QueryColumn *column = &columns[__builtin_ctzll(leaves)];
+        leaves &= leaves - 1;
+        if (column->count < column->capacity)
+        {
+            column->values[column->count] = number;
+        }
+        column->count++;
+    }
+}
+
+// Over a document: subtrees no path goes through are never visited
+void runQueryValue(const Query *query, Value &value, int segment, u64 mask, QueryColumn *columns)
+{
+    switch (value.type)
+    {
+    case Value::OBJECT:
+        for (Member &member : value.object->members)
+        {
+            u64 childMask = matchQueryName(query, segment, mask, member.name.data, member.name.length);
+            if (childMask)
+            {
+                runQueryValue(query, member.value, segment + 1, childMask, columns);
+            }
+        }
+        break;
+    case Value::ARRAY:
+    {
+        u64 index = 0;
+        for (Value &element : value.array->values)
+        {
+            u64 childMask = matchQueryIndex(query, segment, mask, index++);
+            if (childMask)
+            {
+                runQueryValue(query, element, segment + 1, childMask, columns);
+            }
+        }
+        break;
+    }
+    case Value::NUMBER:
+        addQueryNumber(query, segment, mask, value.number, columns);
+        break;
+    default:
+        break;
+    }
+}
+
+// columns has one column per path, in the order the paths were compiled
+void runQuery(const Query *query, Json &json, QueryColumn *columns)
+{
+    u64 mask = query->pathCount == 64 ? ~(u64)0 : ((u64)1 << query->pathCount) - 1;
+    runQueryValue(query, json.value, 0, mask, columns);
+}
+
+// Over the input while it's parsed: the same walk driven by parse events, with
+// one frame per open container
+struct QueryHandler : SaxHandler
+{
+    struct Frame
+    {
+        u64 mask;
+        u64 index;
+        bool array;
+    };
+
+    const Query *query;
+    QueryColumn *columns;
+    // paths still on for the next value
+    u64 mask;
+    int depth;
+    Frame frames[queryMaxSegments + 1];
+
+    // array elements get their mask here, members got it from onKey
+    u64 beginValue()
+    {
+        if (depth > 0 && depth <= queryMaxSegments + 1 && frames[depth - 1].array)
+        {
+            Frame *frame = &frames[depth - 1];
+            mask = matchQueryIndex(query, depth - 1, frame->mask, frame->index++);
+        }
+        return depth <= queryMaxSegments + 1 ? mask : 0;
+    }
+
+    void beginContainer(bool array)
+    {
+        u64 containerMask = beginValue();
+        if (depth <= queryMaxSegments)
+        {
+            frames[depth].mask = containerMask;
+            frames[depth].index = 0;
+            frames[depth].array = array;
+        }
+        depth++;
+    }
+
+    void onObjectBegin() { beginContainer(false); }
+    void onObjectEnd() { depth--; }
+    void onArrayBegin() { beginContainer(true); }
+    void onArrayEnd() { depth--; }
+
+    void onKey(String name)
+    {
+        if (depth <= queryMaxSegments + 1)
+        {
+            mask = matchQueryName(query, depth - 1, frames[depth - 1].mask, name.data, name.length);
+        }
+    }
+
+    void onNumber(f64 value)
+    {
+        u64 valueMask = beginValue();
+        if (valueMask)
+        {
+            addQueryNumber(query, depth, valueMask, value, columns);
+        }
+    }
+
+    void onString(String) { beginValue(); }
+    void onBoolean(bool) { beginValue(); }
+    void onNull() { beginValue(); }
+};
+
+void initQueryHandler(QueryHandler *handler, const Query *query, QueryColumn *columns)
+{
+    handler->query = query;
+    handler->columns = columns;
+    handler->mask = query->pathCount == 64 ? ~(u64)0 : ((u64)1 << query->pathCount) - 1;
+    handler->depth = 0;
+}
+
+// Over a loaded buffer (padded like InputFile), the columns are only complete
+// if the result is
+ParseResult runQuery(const Query *query, const char *buffer, u64 size, QueryColumn *columns, Arena *stringArena)
+{
+    QueryHandler handler;
+    initQueryHandler(&handler, query, columns);
+    return tryEmitDocument(buffer, size, handler, stringArena);
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "Arena.h"
+
+typedef uint64_t u64;
+typedef uint32_t u32;
+
+// Hidden classes for the objects of a document. Every distinct key is
+// interned once per document, and objects with the same keys in the same
+// order share one Shape, reached from the empty shape by one transition per
+// key. The shape knows the slot of each of its keys, so a lookup by name is a
+// scan of a shared key list, a hash probe for wide objects, or with a
+// MemberKey a single pointer compare.
+
+struct Key
+{
+    // canonical copy, unescaped
+    const char *data;
+    u64 length;
+    u64 hash;
+};
+
+struct Shape
+{
+    const Shape *parent;
+    // the key this shape adds to its parent, NULL for the empty shape
+    const Key *key;
+    u32 count;
+    // most recent transition out of this shape, documents tend to repeat the
+    // same key sequence so this is hit almost every time
+    Shape *lastTransition;
+    // keys in slot order, filled once an object ends with this shape
+    const Key **keys;
+    // slot + 1 by key hash for wide shapes, 0 for an empty bucket
+    u32 *index;
+    u32 indexMask;
+};
+
+// Objects up to this many keys are looked up by scanning their keys
+static const u32 wideShapeKeys = 8;
+
+struct ShapeTable
+{
+    Arena *arena;
+    Shape *empty;
+    // open addressing on the name hash
+    Key **keys;
+    u64 keyMask;
+    u64 keyCount;
+    // open addressing on (parent, key)
+    Shape **transitions;
+    u64 transitionMask;
+    u64 transitionCount;
+};
+
+inline u64 hashKey(const char *data, u64 length)
+{
+    // FNV-1a, keys are short
+    u64 hash = 0xcbf29ce484222325;
+    for (u64 i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+inline u64 hashTransition(const Shape *parent, const Key *key)
+{
+    u64 hash = ((u64)(uintptr_t)parent ^ ((u64)(uintptr_t)key << 1)) * 0x9e3779b97f4a7c15;
+    return hash ^ (hash >> 29);
+}
+
+inline bool keyEquals(const Key *key, const char *data, u64 length)
+{
+    return key->length == length && memcmp(key->data, data, length) == 0;
+}
+
+void initShapeTable(ShapeTable *table, Arena *arena)
+{
+    table->arena = arena;
+    table->empty = arena->create<Shape>();
+    table->keyMask = 63;
+    table->keyCount = 0;
+    table->keys = arena->allocateArray<Key *>(table->keyMask + 1);
+    memset(table->keys, 0, (table->keyMask + 1) * sizeof(Key *));
+    table->transitionMask = 63;
+    table->transitionCount = 0;
+    table->transitions = arena->allocateArray<Shape *>(table->transitionMask + 1);
+    memset(table->transitions, 0, (table->transitionMask + 1) * sizeof(Shape *));
+}
+
+// Old tables stay in the arena, growth is geometric so that's at most as much again
+void growKeys(ShapeTable *table)
+{
+    u64 mask = table->keyMask * 2 + 1;
+    Key **keys = table->arena->allocateArray<Key *>(mask + 1);
+    memset(keys, 0, (mask + 1) * sizeof(Key *));
+    for (u64 i = 0; i <= table->keyMask; i++)
+    {
+        Key *key = table->keys[i];
+        if (key)
+        {
+            u64 slot = key->hash & mask;
+            while (keys[slot])
+            {
+                slot = (slot + 1) & mask;
+            }
+            keys[slot] = key;
+        }
+    }
+    table->keys = keys;
+    table->keyMask = mask;
+}
+
+void growTransitions(ShapeTable *table)
+{
+    u64 mask = table->transitionMask * 2 + 1;
+    Shape **transitions = table->arena->allocateArray<Shape *>(mask + 1);
+    memset(transitions, 0, (mask + 1) * sizeof(Shape *));
+    for (u64 i = 0; i <= table->transitionMask; i++)
+    {
+        Shape *shape = table->transitions[i];
+        if (shape)
+        {
+            u64 slot = hashTransition(shape->parent, shape->key) & mask;
+            while (transitions[slot])
+            {
+                slot = (slot + 1) & mask;
+            }
+            transitions[slot] = shape;
+        }
+    }
+    table->transitions = transitions;
+    table->transitionMask = mask;
+}
+
+// The canonical key for these bytes, which have to live as long as the document
+const Key *internKey(ShapeTable *table, const char *data, u64 length)
+{
+    u64 hash = hashKey(data, length);
+    u64 slot = hash & table->keyMask;
+    while (Key *key = table->keys[slot])
+    {
+        if (key->hash == hash && keyEquals(key, data, length))
+        {
+            return key;
+        }
+        slot = (slot + 1) & table->keyMask;
+    }
+
+    Key *key = table->arena->create<Key>();
+    key->data = data;
+    key->length = length;
+    key->hash = hash;
+    table->keys[slot] = key;
+    if (++table->keyCount * 2 > table->keyMask)
+    {
+        growKeys(table);
+    }
+    return key;
+}
+
+// Shape of an object that has the keys of shape followed by this one
+Shape *getNextShape(ShapeTable *table, Shape *shape, const char *data, u64 length)
+{
+    Shape *next = shape->lastTransition;
+    if (next && keyEquals(next->key, data, length))
+    {
+        return next;
+    }
+
+    const Key *key = internKey(table, data, length);
+    u64 slot = hashTransition(shape, key) & table->transitionMask;
+    while ((next = table->transitions[slot]))
+    {
+        if (next->parent == shape && next->key == key)
+        {
+            shape->lastTransition = next;
+            return next;
+        }
+        slot = (slot + 1) & table->transitionMask;
+    }
+
+    next = table->arena->create<Shape>();
+    next->parent = shape;
+    next->key = key;
+    next->count = shape->count + 1;
+    table->transitions[slot] = next;
+    if (++table->transitionCount * 2 > table->transitionMask)
+    {
+        growTransitions(table);
+    }
+    shape->lastTransition = next;
+    return next;
+}
+
+// Lays out the keys of a shape objects end with, and hashes them if it's wide
+void finishShape(ShapeTable *table, Shape *shape)
+{
+    if (shape->keys || shape->count == 0)
+    {
+        return;
+    }
+
+    const Key **keys = table->arena->allocateArray<const Key *>(shape->count);
+    const Shape *ancestor = shape;
+    for (u32 slot = shape->count; slot > 0; slot--)
+    {
+        keys[slot - 1] = ancestor->key;
+        ancestor = ancestor->parent;
+    }
+
+    if (shape->count > wideShapeKeys)
+    {
+        u32 mask = 1;
+        while (mask + 1 < shape->count * 2)
+        {
+            mask = mask * 2 + 1;
+        }
+        u32 *index = table->arena->allocateArray<u32>(mask + 1);
+        memset(index, 0, (mask + 1) * sizeof(u32));
+        for (u32 slot = 0; slot < shape->count; slot++)
+        {
+            // only the first of duplicated keys can be found, like the scan
+            u32 bucket = (u32)keys[slot]->hash & mask;
+            bool duplicate = false;
+            while (index[bucket])
+            {
+                duplicate = duplicate || keys[index[bucket] - 1] == keys[slot];
+                bucket = (bucket + 1) & mask;
+            }
+            if (!duplicate)
+            {
+                index[bucket] = slot + 1;
+            }
+        }
+        shape->index = index;
+        shape->indexMask = mask;
+    }
+    shape->keys = keys;
+}
+
+// Slot of the first key with this name, -1 if the shape doesn't have it
+inline int64_t findShapeSlot(const Shape *shape, const char *data, u64 length)
+{
+    if (shape->index)
+    {
+        u64 hash = hashKey(data, length);
+        u32 bucket = (u32)hash & shape->indexMask;
+        while (u32 slot = shape->index[bucket])
+        {
+            const Key *key = shape->keys[slot - 1];
+            if (key->hash == hash && keyEquals(key, data, length))
+            {
+                return slot - 1;
+            }
+            bucket = (bucket + 1) & shape->indexMask;
+        }
+        return -1;
+    }
+
+    for (u32 slot = 0; slot < shape->count; slot++)
+    {
+        if (keyEquals(shape->keys[slot], data, length))
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Lookup by name that remembers the slot it found for the last shape it saw,
+// so reading the same member out of objects of one shape is a pointer compare
+struct MemberKey
+{
+    const char *name;
+    u64 length;
+    const Shape *shape;
+    int64_t slot;
+
+    MemberKey(const char *name)
+    {
+        this->name = name;
+        length = strlen(name);
+        shape = NULL;
+        slot = -1;
+    }
+};
+
+inline int64_t findShapeSlot(const Shape *shape, MemberKey *key)
+{
+    if (key->shape != shape)
+    {
+        key->slot = findShapeSlot(shape, key->name, key->length);
+        key->shape = shape;
+    }
+    return key->slot;
+}
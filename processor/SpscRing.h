@@ -0,0 +1,159 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define SPSC_RING_PAUSE() _mm_pause()
+#else
+#define SPSC_RING_PAUSE()
+#endif
+#include "profiler/profiler.h"
+
+typedef uint64_t u64;
+
+// Bounded lock-free queue between exactly one producer and one consumer
+// thread. The ring only moves sequence numbers: the slots are an array of the
+// caller's, slot i % capacity is written by the producer between reserve and
+// publish and read by the consumer between acquire and release. The consumer
+// may hold several slots at once, they are released oldest first.
+//
+// head and tail sit on their own cache lines, and each side keeps a copy of
+// the other's counter so the shared line is only read when the ring looks
+// full or empty.
+struct SpscRing
+{
+    u64 capacity;
+    // spins before yielding, 0 when there aren't enough cores for the other
+    // side to make progress while we spin
+    u64 spinCount;
+
+    alignas(64) std::atomic<u64> head;
+    // producer side
+    u64 cachedTail;
+
+    alignas(64) std::atomic<u64> tail;
+    // consumer side: next slot to acquire, which runs ahead of tail while
+    // slots are held
+    u64 cachedHead;
+    u64 next;
+
+    // set by a producer that is done, or by either side giving up
+    alignas(64) std::atomic<bool> closed;
+};
+
+// Times one side of a ring had to wait: for a free slot on the producer
+// side, for a published one on the consumer side
+struct RingStalls
+{
+    u64 count;
+    u64 nanoseconds;
+};
+
+inline void initSpscRing(SpscRing *ring, u64 capacity)
+{
+    ring->capacity = capacity;
+    ring->spinCount = std::thread::hardware_concurrency() > 2 ? 1024 : 0;
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->cachedTail = 0;
+    ring->cachedHead = 0;
+    ring->next = 0;
+    ring->closed.store(false, std::memory_order_relaxed);
+}
+
+inline void waitForRing(const SpscRing *ring, u64 *spins)
+{
+    if ((*spins)++ < ring->spinCount)
+    {
+        SPSC_RING_PAUSE();
+    }
+    else
+    {
+        std::this_thread::yield();
+    }
+}
+
+inline void closeSpscRing(SpscRing *ring)
+{
+    ring->closed.store(true, std::memory_order_release);
+}
+
+// Producer: sequence number of the next slot to fill, false if the consumer
+// closed the ring
+inline bool reserveRingSlot(SpscRing *ring, u64 *sequence, RingStalls *stalls)
+{
+    if (ring->closed.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    u64 head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->cachedTail == ring->capacity)
+    {
+        ring->cachedTail = ring->tail.load(std::memory_order_acquire);
+        if (head - ring->cachedTail == ring->capacity)
+        {
+            u64 start = readOsTimer();
+            u64 spins = 0;
+            do
+            {
+                if (ring->closed.load(std::memory_order_acquire))
+                {
+                    return false;
+                }
+                waitForRing(ring, &spins);
+                ring->cachedTail = ring->tail.load(std::memory_order_acquire);
+            } while (head - ring->cachedTail == ring->capacity);
+            stalls->count++;
+            stalls->nanoseconds += readOsTimer() - start;
+        }
+    }
+    *sequence = head;
+    return true;
+}
+
+inline void publishRingSlot(SpscRing *ring)
+{
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Consumer: sequence number of the next published slot, false once the ring is
+// closed and every published slot was acquired
+inline bool acquireRingSlot(SpscRing *ring, u64 *sequence, RingStalls *stalls)
+{
+    if (ring->next == ring->cachedHead)
+    {
+        ring->cachedHead = ring->head.load(std::memory_order_acquire);
+        if (ring->next == ring->cachedHead)
+        {
+            u64 start = readOsTimer();
+            u64 spins = 0;
+            do
+            {
+                if (ring->closed.load(std::memory_order_acquire))
+                {
+                    // a last publish may have come right before the close
+                    ring->cachedHead = ring->head.load(std::memory_order_acquire);
+                    if (ring->next == ring->cachedHead)
+                    {
+                        return false;
+                    }
+                    break;
+                }
+                waitForRing(ring, &spins);
+                ring->cachedHead = ring->head.load(std::memory_order_acquire);
+            } while (ring->next == ring->cachedHead);
+            stalls->count++;
+            stalls->nanoseconds += readOsTimer() - start;
+        }
+    }
+    *sequence = ring->next++;
+    return true;
+}
+
+// Hands the oldest acquired slot back to the producer
+inline void releaseRingSlot(SpscRing *ring)
+{
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include "InputFile.h"
+#include "SpscRing.h"
+
+typedef uint64_t u64;
+
+struct StreamOptions
+{
+    // bytes read per block, and how many blocks the reader can fill ahead
+    u64 bufferSize = 1024 * 1024;
+    int bufferCount = 3;
+    // room in front of every block for the unparsed end of the previous one,
+    // so a token cut by a block boundary becomes contiguous again; this is
+    // the longest token (or record) a stream can hold
+    u64 carryCapacity = 64 * 1024;
+};
+
+// One block of the file: [carry room][data][zero padding]
+struct StreamBlock
+{
+    char *memory;
+    char *data;
+    u64 size;
+    // offset of data[0] in the file
+    u64 offset;
+    bool last;
+};
+
+// Background reader: a thread read()s the file block by block into a fixed
+// set of buffers while the consumer works on the previous ones. Memory is
+// bufferCount * (carryCapacity + bufferSize + padding) whatever the file size.
+struct StreamReader
+{
+    StreamOptions options;
+    int fd = -1;
+    StreamBlock *blocks = NULL;
+
+    // blocks are filled, acquired and released in a circle; the reader waits
+    // while every buffer is filled but not yet released
+    SpscRing ring;
+    // set before the block that failed is published
+    std::atomic<bool> failed{false};
+    std::thread thread;
+
+    // reader waiting for a released buffer, consumer waiting for a filled one
+    RingStalls fullStalls = RingStalls();
+    RingStalls emptyStalls = RingStalls();
+    // time the reader spent in read()
+    u64 readNanoseconds = 0;
+};
+
+inline void runStreamReader(StreamReader *reader)
+{
+    u64 offset = 0;
+    u64 i;
+    while (reserveRingSlot(&reader->ring, &i, &reader->fullStalls))
+    {
+        StreamBlock *block = &reader->blocks[i % reader->options.bufferCount];
+        u64 size = 0;
+        bool failed = false;
+        u64 start = readOsTimer();
+        while (size < reader->options.bufferSize)
+        {
+            ssize_t bytesRead = read(reader->fd, block->data + size, reader->options.bufferSize - size);
+            if (bytesRead < 0)
+            {
+                failed = true;
+                break;
+            }
+            if (bytesRead == 0)
+            {
+                break;
+            }
+            size += bytesRead;
+        }
+        reader->readNanoseconds += readOsTimer() - start;
+        memset(block->data + size, 0, inputPadding);
+        block->size = size;
+        block->offset = offset;
+        block->last = size < reader->options.bufferSize || failed;
+        offset += size;
+
+        if (failed)
+        {
+            reader->failed.store(true, std::memory_order_relaxed);
+        }
+        publishRingSlot(&reader->ring);
+        if (block->last)
+        {
+            closeSpscRing(&reader->ring);
+            return;
+        }
+    }
+}
+
+inline void closeStreamReader(StreamReader *reader)
+{
+    if (reader->thread.joinable())
+    {
+        closeSpscRing(&reader->ring);
+        reader->thread.join();
+    }
+    if (reader->fd >= 0)
+    {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+    if (reader->blocks)
+    {
+        for (int i = 0; i < reader->options.bufferCount; i++)
+        {
+            free(reader->blocks[i].memory);
+        }
+        delete[] reader->blocks;
+        reader->blocks = NULL;
+    }
+}
+
+inline void openStreamReader(const char *fileName, StreamReader *reader, const StreamOptions &options = StreamOptions())
+{
+    if (options.bufferCount < 2 || options.bufferSize == 0)
+    {
+        throw std::runtime_error("A stream needs at least two non-empty buffers.");
+    }
+
+    reader->options = options;
+    reader->fd = open(fileName, O_RDONLY);
+    if (reader->fd < 0)
+    {
+        throw std::runtime_error("Failed to open input file.");
+    }
+    posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    reader->blocks = new StreamBlock[options.bufferCount]();
+    for (int i = 0; i < options.bufferCount; i++)
+    {
+        char *memory = (char *)malloc(options.carryCapacity + options.bufferSize + inputPadding);
+        if (!memory)
+        {
+            closeStreamReader(reader);
+            throw std::bad_alloc();
+        }
+        reader->blocks[i].memory = memory;
+        reader->blocks[i].data = memory + options.carryCapacity;
+    }
+    initSpscRing(&reader->ring, options.bufferCount);
+
+    reader->thread = std::thread(runStreamReader, reader);
+}
+
+// Waits for the next block; it stays valid until releaseStreamBlock() is
+// called for it. Up to bufferCount - 1 blocks can be held at once.
+inline StreamBlock *acquireStreamBlock(StreamReader *reader)
+{
+    u64 i;
+    if (!acquireRingSlot(&reader->ring, &i, &reader->emptyStalls))
+    {
+        throw std::runtime_error("Read past the end of the input file.");
+    }
+    if (reader->failed.load(std::memory_order_relaxed))
+    {
+        throw std::runtime_error("Failed to read input file.");
+    }
+    return &reader->blocks[i % reader->options.bufferCount];
+}
+
+// Releases the oldest acquired block
+inline void releaseStreamBlock(StreamReader *reader)
+{
+    releaseRingSlot(&reader->ring);
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define STRUCTURAL_INDEX_X64
+#endif
+
+typedef uint64_t u64;
+
+// First parsing stage, simdjson style: classify the input 64 bytes at a time
+// and keep one bit per byte for every position the parser has to stop at.
+// Those are the {}[]:, operators outside of strings, both quotes of every
+// string and the first byte of every number or literal. Whitespace and string
+// contents are never marked, so the recursive descent jumps over them.
+
+// Per byte masks of one 64 byte block, bit i is byte i
+struct BlockClasses
+{
+    u64 quote;
+    u64 backslash;
+    u64 whitespace;
+    u64 op;
+};
+
+// What a block needs to know about the previous one
+struct StructuralState
+{
+    u64 inString = 0;
+    u64 escaped = 0;
+    u64 scalar = 0;
+};
+
+#ifdef STRUCTURAL_INDEX_X64
+
+__attribute__((target("avx2"))) inline u64 classifyHalfAvx2(__m256i bytes, char c)
+{
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c)));
+}
+
+__attribute__((target("avx2"))) inline void classifyBlockAvx2(const char *block, BlockClasses *classes)
+{
+    u64 quote = 0, backslash = 0, whitespace = 0, op = 0;
+    for (int half = 0; half < 2; half++)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(block + half * 32));
+        // '[' and ']' are '{' and '}' without the 0x20 bit
+        __m256i folded = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+        int shift = half * 32;
+
+        quote |= classifyHalfAvx2(bytes, '"') << shift;
+        backslash |= classifyHalfAvx2(bytes, '\\') << shift;
+        whitespace |= (classifyHalfAvx2(bytes, ' ') | classifyHalfAvx2(bytes, '\n') |
+                       classifyHalfAvx2(bytes, '\t') | classifyHalfAvx2(bytes, '\r'))
+                      << shift;
+        op |= (classifyHalfAvx2(folded, '{') | classifyHalfAvx2(folded, '}') |
+               classifyHalfAvx2(bytes, ':') | classifyHalfAvx2(bytes, ','))
+              << shift;
+    }
+    classes->quote = quote;
+    classes->backslash = backslash;
+    classes->whitespace = whitespace;
+    classes->op = op;
+}
+
+// pcmpeqb/pmovmskb are all we need, so the baseline path only requires SSE2
+inline u64 classifyQuarterSse(__m128i bytes, char c)
+{
+    return (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+}
+
+inline void classifyBlockSse(const char *block, BlockClasses *classes)
+{
+    u64 quote = 0, backslash = 0, whitespace = 0, op = 0;
+    for (int quarter = 0; quarter < 4; quarter++)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(block + quarter * 16));
+        __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+        int shift = quarter * 16;
+
+        quote |= classifyQuarterSse(bytes, '"') << shift;
+        backslash |= classifyQuarterSse(bytes, '\\') << shift;
+        whitespace |= (classifyQuarterSse(bytes, ' ') | classifyQuarterSse(bytes, '\n') |
+                       classifyQuarterSse(bytes, '\t') | classifyQuarterSse(bytes, '\r'))
+                      << shift;
+        op |= (classifyQuarterSse(folded, '{') | classifyQuarterSse(folded, '}') |
+               classifyQuarterSse(bytes, ':') | classifyQuarterSse(bytes, ','))
+              << shift;
+    }
+    classes->quote = quote;
+    classes->backslash = backslash;
+    classes->whitespace = whitespace;
+    classes->op = op;
+}
+
+#endif
+
+inline void classifyBlockScalar(const char *block, BlockClasses *classes)
+{
+    u64 quote = 0, backslash = 0, whitespace = 0, op = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        u64 bit = (u64)1 << i;
+        switch (block[i])
+        {
+        case '"':
+            quote |= bit;
+            break;
+        case '\\':
+            backslash |= bit;
+            break;
+        case ' ':
+        case '\n':
+        case '\t':
+        case '\r':
+            whitespace |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            op |= bit;
+            break;
+        }
+    }
+    classes->quote = quote;
+    classes->backslash = backslash;
+    classes->whitespace = whitespace;
+    classes->op = op;
+}
+
+// Bytes preceded by an odd run of backslashes. Backslashes are rare in our
+// inputs so walking them one by one is cheaper than the carry tricks.
+inline u64 getEscaped(u64 backslash, StructuralState *state)
+{
+    if (!(backslash | state->escaped))
+    {
+        return 0;
+    }
+
+    u64 escaped = state->escaped;
+    u64 escapers = backslash & ~state->escaped;
+    state->escaped = 0;
+    while (escapers)
+    {
+        int i = __builtin_ctzll(escapers);
+        escapers &= escapers - 1;
+        if (i == 63)
+        {
+            state->escaped = 1;
+        }
+        else
+        {
+            u64 next = (u64)1 << (i + 1);
+            escaped |= next;
+            escapers &= ~next;
+        }
+    }
+    return escaped;
+}
+
+inline u64 prefixXor(u64 bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+inline u64 getStructurals(const BlockClasses &classes, StructuralState *state)
+{
+    u64 quote = classes.quote & ~getEscaped(classes.backslash, state);
+
+    // set from an opening quote up to, but not including, its closing quote
+    u64 inString = prefixXor(quote) ^ state->inString;
+    state->inString = (u64)((int64_t)inString >> 63);
+
+    u64 scalar = ~(classes.whitespace | classes.op | quote | inString);
+    u64 scalarStart = scalar & ~((scalar << 1) | state->scalar);
+    state->scalar = scalar >> 63;
+
+    return (classes.op & ~inString) | quote | scalarStart;
+}
+
+enum StructuralKernel
+{
+    KERNEL_SCALAR,
+    KERNEL_SSE,
+    KERNEL_AVX2,
+};
+
+inline StructuralKernel getStructuralKernel()
+{
+#ifdef STRUCTURAL_INDEX_X64
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return KERNEL_AVX2;
+    }
+    return KERNEL_SSE;
+#else
+    return KERNEL_SCALAR;
+#endif
+}
+
+inline u64 getStructuralWords(u64 size)
+{
+    return (size + 63) / 64;
+}
+
+// Classifies words [firstWord, firstWord + words) of the buffer into bits,
+// carrying the string/escape state in state. The buffer must be readable up to
+// the next multiple of 64 bytes, which the padding of InputFile guarantees;
+// bits past size are cleared.
+inline void buildStructuralBlocks(const char *buffer, u64 size, u64 firstWord, u64 words, u64 *bits, StructuralState *state, StructuralKernel kernel)
+{
+    BlockClasses classes;
+    for (u64 i = 0; i < words; i++)
+    {
+        const char *block = buffer + (firstWord + i) * 64;
+#ifdef STRUCTURAL_INDEX_X64
+        if (kernel == KERNEL_AVX2)
+        {
+            classifyBlockAvx2(block, &classes);
+        }
+        else if (kernel == KERNEL_SSE)
+        {
+            classifyBlockSse(block, &classes);
+        }
+        else
+#endif
+        {
+            classifyBlockScalar(block, &classes);
+        }
+        bits[i] = getStructurals(classes, state);
+    }
+
+    if (firstWord + words == getStructuralWords(size) && size % 64 != 0)
+    {
+        bits[words - 1] &= ((u64)1 << (size % 64)) - 1;
+    }
+}
+
+// Fills one bit per input byte into bits, which holds getStructuralWords(size) words
+inline void buildStructuralIndex(const char *buffer, u64 size, u64 *bits, StructuralKernel kernel = getStructuralKernel())
+{
+    StructuralState state = StructuralState();
+    buildStructuralBlocks(buffer, size, 0, getStructuralWords(size), bits, &state, kernel);
+}
+
+// Position of the first marked byte at or after position, size if there is none
+inline u64 nextStructural(const u64 *bits, u64 size, u64 position)
+{
+    if (position >= size)
+    {
+        return size;
+    }
+
+    u64 word = position / 64;
+    u64 words = getStructuralWords(size);
+    u64 mask = bits[word] & (~(u64)0 << (position % 64));
+    while (!mask)
+    {
+        if (++word == words)
+        {
+            return size;
+        }
+        mask = bits[word];
+    }
+    return word * 64 + __builtin_ctzll(mask);
+}
+
+// 64KB of input per window
+static const u64 structuralWindowWords = 1024;
+
+// Sliding version of the index: only a window of the bitmap exists at a time
+// and it is refilled as the parser moves forward, so the index costs a fixed
+// 8KB whatever the input size. Positions before the window can't be queried.
+struct StructuralIndex
+{
+    const char *buffer;
+    u64 size;
+    u64 firstWord;
+    u64 words;
+    StructuralState state;
+    StructuralKernel kernel;
+    u64 bits[structuralWindowWords];
+};
+
+inline void initStructuralIndex(StructuralIndex *index, const char *buffer, u64 size)
+{
+    index->buffer = buffer;
+    index->size = size;
+    index->firstWord = 0;
+    index->words = 0;
+    index->state = StructuralState();
+    index->kernel = getStructuralKernel();
+}
+
+inline bool advanceStructuralWindow(StructuralIndex *index)
+{
+    u64 totalWords = getStructuralWords(index->size);
+    u64 firstWord = index->firstWord + index->words;
+    if (firstWord >= totalWords)
+    {
+        return false;
+    }
+
+    u64 words = totalWords - firstWord;
+    if (words > structuralWindowWords)
+    {
+        words = structuralWindowWords;
+    }
+    buildStructuralBlocks(index->buffer, index->size, firstWord, words, index->bits, &index->state, index->kernel);
+    index->firstWord = firstWord;
+    index->words = words;
+    return true;
+}
+
+inline u64 nextStructural(StructuralIndex *index, u64 position)
+{
+    if (position >= index->size)
+    {
+        return index->size;
+    }
+
+    u64 word = position / 64;
+    while (word >= index->firstWord + index->words)
+    {
+        if (!advanceStructuralWindow(index))
+        {
+            return index->size;
+        }
+    }
+
+    u64 mask = index->bits[word - index->firstWord] & (~(u64)0 << (position % 64));
+    while (!mask)
+    {
+        word++;
+        if (word == index->firstWord + index->words && !advanceStructuralWindow(index))
+        {
+            return index->size;
+        }
+        mask = index->bits[word - index->firstWord];
+    }
+    return word * 64 + __builtin_ctzll(mask);
+}
@@ -1,81 +1,666 @@
 #include <stdio.h>
 #include "parser.h"
+#include "JsonTape.h"
+#include "pairs.h"
+#include "Batch.h"
 #include "solver/solver.h"
+#include "solver/sum.h"
+#include "solver/verify.h"
+#include "profiler/profiler.h"
 
 typedef double f64;
 
+static const u64 verifyBatchSize = 1024;
+
+struct Totals
+{
+    Sum totalDistance;
+    u64 count;
+    // index of the first pair, when only a chunk of them is accumulated here
+    u64 first;
+    // answers to compare against, if provided: distances wait in pending and
+    // are verified a batch at a time
+    const f64 *answers;
+    u64 answersCount;
+    VerifyOptions verifyOptions;
+    VerifyReport report;
+    u64 pendingCount;
+    f64 pending[verifyBatchSize];
+};
+
+void verifyPending(Totals *totals)
+{
+    // distances past the end of the answers are reported by the length check
+    u64 first = totals->first + totals->count - totals->pendingCount;
+    u64 count = totals->pendingCount;
+    if (first + count > totals->answersCount)
+    {
+        count = first < totals->answersCount ? totals->answersCount - first : 0;
+    }
+    verifyValues(totals->pending, totals->answers + first, count, first, totals->verifyOptions, &totals->report);
+    totals->pendingCount = 0;
+}
+
+void addDistance(Totals *totals, f64 distance)
+{
+    addToSum(&totals->totalDistance, distance);
+    totals->count++;
+
+    if (totals->answers)
+    {
+        totals->pending[totals->pendingCount++] = distance;
+        if (totals->pendingCount == verifyBatchSize)
+        {
+            verifyPending(totals);
+        }
+    }
+}
+
+void addPair(Totals *totals, f64 x0, f64 y0, f64 x1, f64 y1)
+{
+    addDistance(totals, referenceHaversine(x0, y0, x1, y1, 6372.8));
+}
+
+void computePairs(Pairs *pairs, Totals *totals, HaversineKernel kernel)
+{
+    f64 distances[1024];
+    for (u64 start = 0; start < pairs->count; start += 1024)
+    {
+        u64 count = pairs->count - start < 1024 ? pairs->count - start : 1024;
+        batchHaversine(pairs->x0 + start, pairs->y0 + start, pairs->x1 + start, pairs->y1 + start, count, 6372.8, distances, kernel);
+        for (u64 i = 0; i < count; i++)
+        {
+            addDistance(totals, distances[i]);
+        }
+    }
+}
+
+// The last answer is the average
+bool isAverageCorrect(f64 averageDistance, f64 expected, const VerifyOptions &options)
+{
+    return getUlpDistance(averageDistance, expected) <= options.maxUlp || fabs(averageDistance - expected) <= options.maxAbsolute;
+}
+
+// What a batch worker keeps from one file to the next: the columns and the
+// input buffer in pairs, and the answers mapping
+struct BatchWorker
+{
+    Pairs pairs;
+    Arena answersArena;
+    Totals totals;
+};
+
+void processBatchFile(BatchWorker *worker, BatchFile *file, const LoadOptions &loadOptions, HaversineKernel kernel, SumMode sumMode, const VerifyOptions &verifyOptions)
+{
+    u64 start = readOsTimer();
+    Totals *totals = &worker->totals;
+    *totals = Totals();
+    initSum(&totals->totalDistance, sumMode);
+    initVerifyReport(&totals->report);
+    totals->verifyOptions = verifyOptions;
+
+    InputFile answersFile = InputFile();
+    u64 answersValues = 0;
+    worker->answersArena.reset();
+    file->status = BATCH_FAILED;
+    if (!file->answers.empty())
+    {
+        LoadOptions answersOptions = LoadOptions();
+        answersOptions.mode = LoadOptions::MMAP;
+        try
+        {
+            openInputFile(file->answers.c_str(), &answersFile, answersOptions, &worker->answersArena);
+            answersValues = answersFile.size / sizeof(f64);
+        }
+        catch (const std::exception &e)
+        {
+            // workers don't print, the report says why
+            file->error = std::string("Can't read the answers: ") + e.what();
+        }
+    }
+
+    if (answersValues > 0)
+    {
+        totals->answers = (const f64 *)answersFile.data;
+        totals->answersCount = answersValues - 1;
+    }
+
+    if (file->answers.empty() || answersValues > 0)
+    {
+        ParseResult result = parsePairs(file->input.c_str(), &worker->pairs, loadOptions);
+        if (!result.ok())
+        {
+            char message[128];
+            formatParseResult(result, message, sizeof(message));
+            file->error = message;
+        }
+        else if (worker->pairs.count == 0)
+        {
+            // no average to give
+            file->error = "No pairs";
+        }
+    }
+    else if (file->error.empty())
+    {
+        file->error = "Empty answers";
+    }
+
+    if (file->error.empty())
+    {
+        computePairs(&worker->pairs, totals, kernel);
+        file->count = totals->count;
+        file->totalDistance = getSum(&totals->totalDistance);
+        file->averageDistance = file->totalDistance / totals->count;
+        file->status = BATCH_COMPUTED;
+        if (totals->answers)
+        {
+            verifyPending(totals);
+            file->mismatches = totals->report.mismatches;
+            file->maxUlp = totals->report.maxUlp;
+            bool correct = answersValues == totals->count + 1 && totals->report.mismatches == 0 &&
+                           isAverageCorrect(file->averageDistance, totals->answers[answersValues - 1], verifyOptions);
+            file->status = correct ? BATCH_CORRECT : BATCH_MISMATCH;
+        }
+    }
+    closeInputFile(&answersFile);
+    file->nanoseconds = readOsTimer() - start;
+}
+
+// Returns false if the batch couldn't be listed, or any of its files failed
+// or didn't match its answers
+bool runBatch(const char *path, int workerCount, const LoadOptions &loadOptions, HaversineKernel kernel, SumMode sumMode, const VerifyOptions &verifyOptions)
+{
+    std::vector<BatchFile> files;
+    if (!listBatchFiles(path, &files))
+    {
+        printf("Can't list the files of %s\n", path);
+        return false;
+    }
+    if (workerCount > (int)files.size())
+    {
+        workerCount = files.size() > 0 ? files.size() : 1;
+    }
+#if PROFILER
+    // profile zones are only opened on the main thread
+    workerCount = 1;
+#endif
+
+    BatchWorker *workers = new BatchWorker[workerCount];
+    u64 start = readOsTimer();
+    runBatchQueue(files, workerCount, [&](int worker, BatchFile *file)
+                  { processBatchFile(&workers[worker], file, loadOptions, kernel, sumMode, verifyOptions); });
+    u64 wallNanoseconds = readOsTimer() - start;
+    delete[] workers;
+
+    return printBatchReport(files, workerCount, wallNanoseconds);
+}
+
+// Returns false, after saying where, if the input was malformed
+bool checkParseResult(const char *inputFileName, const ParseResult &result)
+{
+    if (!result.ok())
+    {
+        char message[128];
+        formatParseResult(result, message, sizeof(message));
+        printf("Can't parse %s: %s\n", inputFileName, message);
+    }
+    return result.ok();
+}
+
 int main(int argc, char const *argv[])
 {
-    if (argc != 2 && argc != 3)
+    // split the flags from the positional arguments
+    LoadOptions loadOptions = LoadOptions();
+    const char *arguments[2] = {NULL, NULL};
+    int argumentsCount = 0;
+    bool validArguments = true;
+    bool buildTree = false;
+    bool buildTape = false;
+    bool lazy = false;
+    bool stream = false;
+    bool query = false;
+    bool binary = false;
+    bool streamInput = false;
+    bool pipeline = false;
+    bool batch = false;
+    StreamOptions streamOptions = StreamOptions();
+    bool verifyChecksum = true;
+    HaversineKernel kernel = HAVERSINE_REFERENCE;
+    // 0 when not given: one thread, or one batch worker per core
+    int threadCount = 0;
+    SumMode sumMode = SUM_EXACT;
+    VerifyOptions verifyOptions = VerifyOptions();
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--mmap") == 0)
+        {
+            loadOptions.mode = LoadOptions::MMAP;
+        }
+        else if (strcmp(argv[i], "--populate") == 0)
+        {
+            loadOptions.populate = true;
+        }
+        else if (strcmp(argv[i], "--huge-pages") == 0)
+        {
+            loadOptions.hugePages = true;
+        }
+        else if (strcmp(argv[i], "--dom") == 0)
+        {
+            buildTree = true;
+        }
+        else if (strcmp(argv[i], "--tape") == 0)
+        {
+            buildTape = true;
+        }
+        else if (strcmp(argv[i], "--lazy") == 0)
+        {
+            buildTape = true;
+            lazy = true;
+        }
+        else if (strcmp(argv[i], "--sax") == 0)
+        {
+            stream = true;
+        }
+        else if (strcmp(argv[i], "--query") == 0)
+        {
+            query = true;
+        }
+        else if (strcmp(argv[i], "--stream") == 0)
+        {
+            streamInput = true;
+        }
+        else if (strcmp(argv[i], "--batch") == 0)
+        {
+            batch = true;
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0)
+        {
+            pipeline = true;
+        }
+        else if (strcmp(argv[i], "--stream-buffers") == 0 && i + 1 < argc)
+        {
+            streamOptions.bufferCount = atoi(argv[++i]);
+            validArguments = validArguments && streamOptions.bufferCount >= 2;
+        }
+        else if (strcmp(argv[i], "--binary") == 0)
+        {
+            binary = true;
+        }
+        else if (strcmp(argv[i], "--no-checksum") == 0)
+        {
+            verifyChecksum = false;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+            validArguments = validArguments && threadCount > 0;
+        }
+        else if (strcmp(argv[i], "--sum") == 0 && i + 1 < argc)
+        {
+            validArguments = validArguments && getSumMode(argv[++i], &sumMode);
+        }
+        else if (strcmp(argv[i], "--max-ulp") == 0 && i + 1 < argc)
+        {
+            verifyOptions.maxUlp = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--max-error") == 0 && i + 1 < argc)
+        {
+            verifyOptions.maxAbsolute = atof(argv[++i]);
+            validArguments = validArguments && verifyOptions.maxAbsolute >= 0;
+        }
+        else if (strcmp(argv[i], "--offenders") == 0 && i + 1 < argc)
+        {
+            verifyOptions.offenders = atoi(argv[++i]);
+            validArguments = validArguments && verifyOptions.offenders >= 0 && verifyOptions.offenders <= verifyMaxOffenders;
+        }
+        else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc)
+        {
+            const char *name = argv[++i];
+            if (strcmp(name, "best") == 0)
+            {
+                kernel = getHaversineKernel();
+            }
+            else if (strcmp(name, "avx2") == 0)
+            {
+                kernel = HAVERSINE_AVX2;
+            }
+            else if (strcmp(name, "avx512") == 0)
+            {
+                kernel = HAVERSINE_AVX512;
+            }
+            else if (strcmp(name, "reference") != 0)
+            {
+                validArguments = false;
+            }
+            // running it would end in SIGILL
+            if (kernel > getHaversineKernel())
+            {
+                printf("This CPU doesn't support the %s kernel.\n", name);
+                return 1;
+            }
+        }
+        else if (argv[i][0] != '-' && argumentsCount < 2)
+        {
+            arguments[argumentsCount++] = argv[i];
+        }
+        else
+        {
+            validArguments = false;
+        }
+    }
+
+    if (!validArguments || argumentsCount == 0)
     {
-        printf("Usage:   haversine_processor [input.json]\n");
-        printf("                             [input.json] [answers.f64]\n");
+        printf("Usage:   haversine_processor [options] [input.json]\n");
+        printf("                             [options] [input.json] [answers.f64]\n");
+        printf("                             --batch [directory/manifest]\n");
+        printf("\n");
+        printf("Options: --mmap        map the input file instead of reading it\n");
+        printf("         --populate    prefault the whole input before parsing\n");
+        printf("         --huge-pages  back the input with 2MB pages when possible\n");
+        printf("         --dom         build the whole document before computing\n");
+        printf("         --tape        same, as a flat tape of 64-bit words\n");
+        printf("         --lazy        tape that only decodes the numbers when they\n");
+        printf("                       are read\n");
+        printf("         --sax         compute while parsing, without storing the pairs\n");
+        printf("         --query       extract the columns with /pairs/*/x0 style path\n");
+        printf("                       queries, any record layout works\n");
+        printf("         --stream      read the input on a background thread into a\n");
+        printf("                       few 1MB buffers and compute batch by batch, memory\n");
+        printf("                       stays flat whatever the input size\n");
+        printf("         --pipeline    same, with reading, parsing and computing on\n");
+        printf("                       three threads connected by lock-free rings, and\n");
+        printf("                       a report of where each of them waited\n");
+        printf("         --stream-buffers [n]\n");
+        printf("                       number of stream buffers, 3 by default\n");
+        printf("         --binary      the input is a .bin file from the generator, its\n");
+        printf("                       columns are mapped and computed without parsing\n");
+        printf("         --no-checksum skip the checksum pass over a binary input\n");
+        printf("         --kernel [reference/avx2/avx512/best]\n");
+        printf("                       haversine kernel for the default mode, only\n");
+        printf("                       reference matches the answers bit for bit\n");
+        printf("         --threads [n] split the pairs in n chunks parsed and computed\n");
+        printf("                       in parallel, the total is reproducible for a\n");
+        printf("                       given n\n");
+        printf("         --batch       process every coordinates_*.json of a directory,\n");
+        printf("                       with the results_*.f64 next to them, or every\n");
+        printf("                       'input [answers]' line of a manifest, on --threads\n");
+        printf("                       workers (one per core by default), and print one\n");
+        printf("                       report for all of them\n");
+        printf("         --sum [naive/pairwise/neumaier/exact]\n");
+        printf("                       how the distances are added up, exact (the\n");
+        printf("                       default, what the generator uses) gives the same\n");
+        printf("                       total for any number of threads\n");
+        printf("         --max-ulp [n] accept answers within n ULP, 0 by default\n");
+        printf("         --max-error [x]\n");
+        printf("                       accept answers within x km, 0 by default\n");
+        printf("         --offenders [n]\n");
+        printf("                       mismatches listed in the report, 10 by default\n");
+        printf("                       and 64 at most\n");
         return 1;
     }
 
-    const char *inputFileName = argv[1];
-    const char *resultsFileName = argv[2];
+    // batch files always go through parsePairs, the other modes don't apply
+    if (batch && (buildTree || buildTape || stream || query || streamInput || pipeline || binary || argumentsCount > 1))
+    {
+        printf("--batch only takes a directory or a manifest, and no other mode.\n");
+        return 1;
+    }
 
-    // open the results file if provided
-    FILE *resultsFile = NULL;
-    char *resultsBuffer = NULL;
-    int resultsSize = 0;
+    beginProfile();
+
+    if (batch)
+    {
+        int workerCount = threadCount > 0 ? threadCount : (int)std::thread::hardware_concurrency();
+        bool passed = runBatch(arguments[0], workerCount > 0 ? workerCount : 1, loadOptions, kernel, sumMode, verifyOptions);
+        endAndPrintProfile();
+        return passed ? 0 : 1;
+    }
+
+    const char *inputFileName = arguments[0];
+    const char *resultsFileName = arguments[1];
+
+    // map the answers if provided: one distance per pair, then the average
+    Arena answersArena = Arena();
+    InputFile answersFile = InputFile();
+    u64 answersValues = 0;
     if (resultsFileName)
     {
-        resultsFile = fopen(resultsFileName, "rb");
-        // load the results in a buffer
-        fseek(resultsFile, 0, SEEK_END);
-        resultsSize = ftell(resultsFile);
-        fseek(resultsFile, 0, SEEK_SET);
-        resultsBuffer = new char[resultsSize];
-        fread(resultsBuffer, 1, resultsSize, resultsFile);
-        fclose(resultsFile);
+        LoadOptions answersOptions = LoadOptions();
+        answersOptions.mode = LoadOptions::MMAP;
+        try
+        {
+            openInputFile(resultsFileName, &answersFile, answersOptions, &answersArena);
+            answersValues = answersFile.size / sizeof(f64);
+        }
+        catch (const std::exception &e)
+        {
+            printf("Can't verify against %s: %s\n", resultsFileName, e.what());
+        }
+    }
+
+    Totals totals = Totals();
+    initSum(&totals.totalDistance, sumMode);
+    initVerifyReport(&totals.report);
+    totals.verifyOptions = verifyOptions;
+    if (answersValues > 0)
+    {
+        totals.answers = (const f64 *)answersFile.data;
+        totals.answersCount = answersValues - 1;
+    }
+
+    if (binary)
+    {
+        Pairs pairs = Pairs();
+        if (!checkParseResult(inputFileName, loadBinaryPairs(inputFileName, &pairs, verifyChecksum, loadOptions)))
+        {
+            return 1;
+        }
+        TIME_BANDWIDTH("compute", pairs.count * 4 * sizeof(f64));
+        computePairs(&pairs, &totals, kernel);
+    }
+    else if (pipeline)
+    {
+        PipelineOptions pipelineOptions = PipelineOptions();
+        pipelineOptions.stream = streamOptions;
+        PipelineStats pipelineStats;
+        ParseResult result = pipelinePairsFile(inputFileName, [&](Pairs *pairs)
+                                               { computePairs(pairs, &totals, kernel); },
+                                               pipelineOptions, &pipelineStats);
+        if (result.status == PARSE_UNEXPECTED_SHAPE)
+        {
+            // not the generator's shape, start over with the whole input
+            initSum(&totals.totalDistance, sumMode);
+            initVerifyReport(&totals.report);
+            totals.count = 0;
+            totals.pendingCount = 0;
+            Pairs pairs = Pairs();
+            result = parsePairs(inputFileName, &pairs, loadOptions);
+            if (result.ok())
+            {
+                computePairs(&pairs, &totals, kernel);
+            }
+        }
+        else if (result.ok())
+        {
+            printPipelineStats(&pipelineStats);
+        }
+        if (!checkParseResult(inputFileName, result))
+        {
+            return 1;
+        }
+    }
+    else if (streamInput)
+    {
+        // pairs are computed in batches as they come out of the stream
+        Pairs batch = Pairs();
+        ParseResult result = streamPairsFile(inputFileName, &batch, 4096, [&](Pairs *pairs)
+                                             { computePairs(pairs, &totals, kernel); },
+                                             streamOptions);
+        if (result.status == PARSE_UNEXPECTED_SHAPE)
+        {
+            // not the generator's shape, start over with the whole input
+            initSum(&totals.totalDistance, sumMode);
+            initVerifyReport(&totals.report);
+            totals.count = 0;
+            totals.pendingCount = 0;
+            result = parsePairs(inputFileName, &batch, loadOptions);
+            if (result.ok())
+            {
+                computePairs(&batch, &totals, kernel);
+            }
+        }
+        if (!checkParseResult(inputFileName, result))
+        {
+            return 1;
+        }
     }
+    else if (buildTree)
+    {
+        Json json = Json();
+        if (!checkParseResult(inputFileName, tryParse(inputFileName, json, loadOptions)))
+        {
+            return 1;
+        }
 
-    Json json = parse(inputFileName);
+        ArrayList<Value> &coordinates = json["pairs"].array->values;
+        TIME_BANDWIDTH("compute", coordinates.getSize() * 4 * sizeof(f64));
+        // every pair has the same shape, so these resolve once
+        MemberKey x0("x0"), y0("y0"), x1("x1"), y1("y1");
+        for (Value &coordinate : coordinates)
+        {
+            addPair(&totals, coordinate[x0].number, coordinate[y0].number, coordinate[x1].number, coordinate[y1].number);
+        }
+    }
+    else if (buildTape)
+    {
+        JsonTape tape = JsonTape();
+        if (!checkParseResult(inputFileName, tryParse(inputFileName, tape, loadOptions, lazy)))
+        {
+            return 1;
+        }
 
-    ArrayList<Value> &coordinates = json["pairs"].array->values;
-    f64 totalDistance = 0.0;
-    for (int i = 0; i < coordinates.getSize(); i++)
+        TapeValue coordinates = tape["pairs"];
+        TIME_BANDWIDTH("compute", coordinates.size() * 4 * sizeof(f64));
+        for (TapeValue coordinate : coordinates)
+        {
+            addPair(&totals, coordinate["x0"].getNumber(), coordinate["y0"].getNumber(), coordinate["x1"].getNumber(), coordinate["y1"].getNumber());
+        }
+    }
+    else if (query)
     {
-        Value &coordinate = coordinates[i];
-        f64 x0 = coordinate["x0"].number;
-        f64 y0 = coordinate["y0"].number;
-        f64 x1 = coordinate["x1"].number;
-        f64 y1 = coordinate["y1"].number;
-        f64 distance = referenceHaversine(x0, y0, x1, y1, 6372.8);
-        totalDistance += distance;
+        Pairs pairs = Pairs();
+        if (!checkParseResult(inputFileName, queryPairs(inputFileName, &pairs, loadOptions)))
+        {
+            return 1;
+        }
+        TIME_BANDWIDTH("compute", pairs.count * 4 * sizeof(f64));
+        computePairs(&pairs, &totals, kernel);
+    }
+    else if (stream)
+    {
+        // accumulate while parsing, the document is never materialized
+        PairsHandler<Totals> handler = PairsHandler<Totals>();
+        handler.sink = &totals;
+        if (!checkParseResult(inputFileName, getPairsResult(parseEvents(inputFileName, handler, loadOptions), handler)))
+        {
+            return 1;
+        }
+    }
+    else if (threadCount > 1)
+    {
+        // every chunk is computed on its own thread, then the partial sums are
+        // merged in chunk order
+        Pairs *chunks = new Pairs[threadCount];
+        if (!checkParseResult(inputFileName, parsePairsParallel(inputFileName, chunks, threadCount, loadOptions)))
+        {
+            delete[] chunks;
+            return 1;
+        }
+
+        u64 pairsCount = 0;
+        for (int i = 0; i < threadCount; i++)
+        {
+            pairsCount += chunks[i].count;
+        }
+        TIME_BANDWIDTH("compute", pairsCount * 4 * sizeof(f64));
 
-        // compare the results if provided
-        if (resultsSize > 0)
+        Totals *partials = new Totals[threadCount];
+        std::vector<std::thread> threads;
+        u64 first = 0;
+        for (int i = 0; i < threadCount; i++)
         {
-            f64 result = *(f64 *)(resultsBuffer + i * sizeof(f64));
-            if (result != distance)
+            partials[i] = totals;
+            partials[i].first = first;
+            first += chunks[i].count;
+            threads.emplace_back(computePairs, &chunks[i], &partials[i], kernel);
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+
+        for (int i = 0; i < threadCount; i++)
+        {
+            if (partials[i].answers)
             {
-                printf("Error: result %d is %.20f, expected %.20f\n", i, distance, result);
+                verifyPending(&partials[i]);
             }
+            mergeSum(&totals.totalDistance, &partials[i].totalDistance);
+            mergeVerifyReport(&totals.report, &partials[i].report, verifyOptions);
+            totals.count += partials[i].count;
+        }
+        delete[] partials;
+        delete[] chunks;
+    }
+    else
+    {
+        // decode straight into columns, then compute over them
+        Pairs pairs = Pairs();
+        if (!checkParseResult(inputFileName, parsePairs(inputFileName, &pairs, loadOptions)))
+        {
+            return 1;
         }
+        TIME_BANDWIDTH("compute", pairs.count * 4 * sizeof(f64));
+        computePairs(&pairs, &totals, kernel);
     }
 
-    f64 averageDistance = totalDistance / coordinates.getSize();
+    if (totals.answers)
+    {
+        verifyPending(&totals);
+    }
+
+    f64 totalDistance = getSum(&totals.totalDistance);
+    f64 averageDistance = totalDistance / totals.count;
     printf("Total distance: %.20f\n", totalDistance);
     printf("Average distance: %.20f\n", averageDistance);
 
     // compare the results if provided
-    if (resultsSize > 0)
+    if (totals.answers)
     {
-        f64 result = *(f64 *)(resultsBuffer + coordinates.getSize() * sizeof(f64));
-        if (result != averageDistance)
+        printf("\n");
+        if (answersValues != totals.count + 1)
         {
-            printf("\nError: average distance is %.20f, expected %.20f\n", averageDistance, result);
+            printf("Error: the answers have %llu values, expected %llu (one per pair and the average)\n",
+                   (unsigned long long)answersValues, (unsigned long long)(totals.count + 1));
         }
-        else
+        printVerifyReport(&totals.report);
+
+        // the last value is the average, when the length is right
+        f64 result = totals.answers[answersValues - 1];
+        u64 ulp = getUlpDistance(averageDistance, result);
+        if (answersValues == totals.count + 1 && isAverageCorrect(averageDistance, result, verifyOptions))
         {
             printf("\nAverage distance is correct! ✨\n");
         }
-
-        delete[] resultsBuffer;
+        else
+        {
+            printf("\nError: average distance is %.20f, expected %.20f (%llu ULP)\n", averageDistance, result, (unsigned long long)ulp);
+        }
     }
+    closeInputFile(&answersFile);
+
+    endAndPrintProfile();
 
     return 0;
 }
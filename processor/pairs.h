@@ -0,0 +1,1086 @@
+#pragma once
+
+#include "parser.h"
+#include "PathQuery.h"
+#include "solver/binary.h"
+#include "StreamReader.h"
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <sched.h>
+#include <pthread.h>
+
+// Coordinates of {"pairs":[{"x0":..,"y0":..,"x1":..,"y1":..},...]} decoded
+// into four contiguous columns, the layout the compute loop wants.
+struct Pairs
+{
+    f64 *x0 = NULL;
+    f64 *y0 = NULL;
+    f64 *x1 = NULL;
+    f64 *y1 = NULL;
+    u64 count = 0;
+    u64 capacity = 0;
+    // false when the input didn't have the generator's exact shape and went
+    // through the generic parser
+    bool specialized = false;
+
+    // the columns, and the input buffer while parsing, reused across parses
+    Arena arena;
+    Arena inputArena;
+    // binary file the columns point into, see loadBinaryPairs()
+    InputFile binary;
+
+    Pairs() = default;
+    Pairs(Pairs &&other) = default;
+    Pairs &operator=(Pairs &&other) = default;
+
+    ~Pairs()
+    {
+        closeInputFile(&binary);
+    }
+};
+
+void reservePairs(Pairs *pairs, u64 capacity)
+{
+    if (capacity <= pairs->capacity)
+    {
+        return;
+    }
+
+    f64 *columns[4] = {pairs->x0, pairs->y0, pairs->x1, pairs->y1};
+    for (int i = 0; i < 4; i++)
+    {
+        f64 *column = pairs->arena.allocateArray<f64>(capacity);
+        if (pairs->count > 0)
+        {
+            memcpy(column, columns[i], pairs->count * sizeof(f64));
+        }
+        columns[i] = column;
+    }
+    pairs->x0 = columns[0];
+    pairs->y0 = columns[1];
+    pairs->x1 = columns[2];
+    pairs->y1 = columns[3];
+    pairs->capacity = capacity;
+}
+
+void clearPairs(Pairs *pairs)
+{
+    closeInputFile(&pairs->binary);
+    pairs->arena.reset();
+    pairs->x0 = pairs->y0 = pairs->x1 = pairs->y1 = NULL;
+    pairs->count = 0;
+    pairs->capacity = 0;
+    pairs->specialized = false;
+}
+
+void addPair(Pairs *pairs, f64 x0, f64 y0, f64 x1, f64 y1)
+{
+    if (pairs->count == pairs->capacity)
+    {
+        reservePairs(pairs, pairs->capacity * 2 + 16);
+    }
+    u64 i = pairs->count++;
+    pairs->x0[i] = x0;
+    pairs->y0[i] = y0;
+    pairs->x1[i] = x1;
+    pairs->y1[i] = y1;
+}
+
+// Record count guess from the length of the first record, so the columns are
+// sized once instead of going through ~20 doublings on big files
+u64 estimatePairsCount(const char *buffer, u64 size)
+{
+    const char *first = (const char *)memchr(buffer, '[', size);
+    if (!first)
+    {
+        return 16;
+    }
+    u64 remaining = size - (first - buffer);
+    const char *end = (const char *)memchr(first, '}', remaining);
+    if (!end)
+    {
+        return 16;
+    }
+
+    // the separator between records is ",\n" in generated files
+    u64 recordSize = (end - first) + 2;
+    return remaining / recordSize + remaining / recordSize / 8 + 16;
+}
+
+void skipPairsWhitespace(Parser *parser)
+{
+    char c = peak(parser);
+    while (c == ' ' || c == '\n' || c == '\t' || c == '\r')
+    {
+        parser->current++;
+        c = peak(parser);
+    }
+}
+
+bool expectPairsCharacter(Parser *parser, char c)
+{
+    skipPairsWhitespace(parser);
+    if (peak(parser) != c)
+    {
+        return false;
+    }
+    parser->current++;
+    return true;
+}
+
+// key includes its quotes, the padding makes the compare safe at the end
+bool expectPairsKey(Parser *parser, const char *key, u64 length)
+{
+    skipPairsWhitespace(parser);
+    if (memcmp(parser->buffer + parser->current, key, length) != 0)
+    {
+        return false;
+    }
+    parser->current += length;
+    return expectPairsCharacter(parser, ':');
+}
+
+bool getPairsNumber(Parser *parser, f64 *value)
+{
+    skipPairsWhitespace(parser);
+    if (!isNumberStart(next(parser)))
+    {
+        return false;
+    }
+    *value = getNumber(parser);
+    return parser->status == PARSE_OK;
+}
+
+// {"x0":..,"y0":..,"x1":..,"y1":..} in this exact order, appended to pairs
+bool parsePairsRecord(Parser *parser, Pairs *pairs)
+{
+    if (pairs->count == pairs->capacity)
+    {
+        reservePairs(pairs, pairs->capacity * 2 + 16);
+    }
+    u64 i = pairs->count;
+    if (!expectPairsCharacter(parser, '{') ||
+        !expectPairsKey(parser, "\"x0\"", 4) || !getPairsNumber(parser, &pairs->x0[i]) || !expectPairsCharacter(parser, ',') ||
+        !expectPairsKey(parser, "\"y0\"", 4) || !getPairsNumber(parser, &pairs->y0[i]) || !expectPairsCharacter(parser, ',') ||
+        !expectPairsKey(parser, "\"x1\"", 4) || !getPairsNumber(parser, &pairs->x1[i]) || !expectPairsCharacter(parser, ',') ||
+        !expectPairsKey(parser, "\"y1\"", 4) || !getPairsNumber(parser, &pairs->y1[i]) || !expectPairsCharacter(parser, '}'))
+    {
+        return false;
+    }
+    pairs->count++;
+    return true;
+}
+
+// Only accepts the exact shape written by the generator (whitespace aside),
+// returns false as soon as anything else shows up. Decodes the records that
+// start in [begin, end): begin is 0 or the '{' of a record, and only the range
+// that ends at size checks the closing "]}".
+bool parsePairsRange(const char *buffer, u64 size, u64 begin, u64 end, Pairs *pairs)
+{
+    Parser parser = Parser();
+    parser.buffer = buffer;
+    parser.size = size;
+    parser.current = begin;
+
+    bool empty = false;
+    if (begin == 0)
+    {
+        if (!expectPairsCharacter(&parser, '{') || !expectPairsKey(&parser, "\"pairs\"", 7) || !expectPairsCharacter(&parser, '['))
+        {
+            return false;
+        }
+
+        skipPairsWhitespace(&parser);
+        if (peak(&parser) == ']')
+        {
+            next(&parser);
+            empty = true;
+        }
+    }
+
+    if (!empty)
+    {
+        char c = ',';
+        while (c == ',')
+        {
+            skipPairsWhitespace(&parser);
+            if (end != size && parser.current >= end)
+            {
+                // the next record belongs to the following range
+                return true;
+            }
+
+            if (!parsePairsRecord(&parser, pairs))
+            {
+                return false;
+            }
+
+            skipPairsWhitespace(&parser);
+            c = next(&parser);
+        }
+
+        if (c != ']')
+        {
+            return false;
+        }
+    }
+
+    if (end != size || !expectPairsCharacter(&parser, '}'))
+    {
+        return false;
+    }
+    skipPairsWhitespace(&parser);
+    return parser.current == size;
+}
+
+bool parsePairsSpecialized(const char *buffer, u64 size, Pairs *pairs)
+{
+    return parsePairsRange(buffer, size, 0, size, pairs);
+}
+
+// Generic fallback: picks the coordinates out of the parse events and hands
+// every complete pair to addPair(sink, ...). The pairs are the objects at
+// depth 3 under the "pairs" key, {"pairs": [{...}, ...]}, their keys can come
+// in any order. Objects in the other arrays of the root are skipped, a pair
+// missing a coordinate sets status, see getPairsResult().
+template <typename Sink>
+struct PairsHandler : SaxHandler
+{
+    Sink *sink;
+    ParseStatus status = PARSE_OK;
+    int depth = 0;
+    // the last key of the root was "pairs", and its array is open
+    bool pairsKey = false;
+    bool inPairs = false;
+    f64 coordinates[4];
+    int coordinate = -1;
+    int seen = 0;
+
+    void onObjectBegin()
+    {
+        depth++;
+        if (depth == 3)
+        {
+            seen = 0;
+        }
+    }
+
+    void onObjectEnd()
+    {
+        if (depth == 3 && inPairs && status == PARSE_OK)
+        {
+            if (seen != 0xF)
+            {
+                status = PARSE_MISSING_COORDINATES;
+            }
+            else
+            {
+                addPair(sink, coordinates[0], coordinates[1], coordinates[2], coordinates[3]);
+            }
+        }
+        depth--;
+    }
+
+    void onArrayBegin()
+    {
+        depth++;
+        if (depth == 2)
+        {
+            inPairs = pairsKey;
+        }
+    }
+
+    void onArrayEnd()
+    {
+        if (depth == 2)
+        {
+            inPairs = false;
+        }
+        depth--;
+    }
+
+    void onKey(String name)
+    {
+        coordinate = -1;
+        if (depth == 1)
+        {
+            pairsKey = name.equals("pairs", 5);
+        }
+        else if (depth == 3 && inPairs && name.length == 2 && (name.data[0] == 'x' || name.data[0] == 'y') && (name.data[1] == '0' || name.data[1] == '1'))
+        {
+            coordinate = (name.data[0] - 'x') + (name.data[1] - '0') * 2;
+        }
+    }
+
+    void onNumber(f64 value)
+    {
+        if (coordinate >= 0)
+        {
+            coordinates[coordinate] = value;
+            seen |= 1 << coordinate;
+            coordinate = -1;
+        }
+    }
+};
+
+// The parse's own error first, then a pair the handler couldn't decode
+template <typename Sink>
+ParseResult getPairsResult(const ParseResult &parsed, const PairsHandler<Sink> &handler)
+{
+    return parsed.ok() ? makeParseResult(handler.status, NULL, 0) : parsed;
+}
+
+// Tries the specialized decoder first and falls back to the generic parser
+// when the shape deviates, which reports malformed input
+ParseResult decodePairs(const char *buffer, u64 size, Pairs *pairs)
+{
+    TIME_BANDWIDTH("decodePairs", size);
+    reservePairs(pairs, estimatePairsCount(buffer, size));
+
+    pairs->specialized = parsePairsSpecialized(buffer, size, pairs);
+    if (pairs->specialized)
+    {
+        return makeParseResult(PARSE_OK, buffer, 0);
+    }
+    pairs->count = 0;
+    Arena stringArena = Arena();
+    PairsHandler<Pairs> handler = PairsHandler<Pairs>();
+    handler.sink = pairs;
+    return getPairsResult(tryEmitDocument(buffer, size, handler, &stringArena), handler);
+}
+
+// Never throws: on error the pairs are empty and the result says what went
+// wrong and where
+ParseResult parsePairs(const char *inputFileName, Pairs *pairs, const LoadOptions &options = LoadOptions())
+{
+    clearPairs(pairs);
+    pairs->inputArena.reset();
+    InputFile input = InputFile();
+    ParseResult result;
+
+    try
+    {
+        openInputFile(inputFileName, &input, options, &pairs->inputArena);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+    catch (const std::exception &)
+    {
+        return makeParseResult(PARSE_IO_ERROR, NULL, 0);
+    }
+
+    try
+    {
+        result = decodePairs(input.data, input.size, pairs);
+    }
+    catch (const std::bad_alloc &)
+    {
+        result = makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+
+    closeInputFile(&input);
+    if (!result.ok())
+    {
+        clearPairs(pairs);
+    }
+    return result;
+}
+
+// Pairs wherever the query paths find them, whatever the layout of the
+// records: one compiled query fills the four columns in a single pass. Never
+// throws, like parsePairs().
+ParseResult queryPairs(const char *inputFileName, Pairs *pairs, const LoadOptions &options = LoadOptions())
+{
+    static const char *const paths[4] = {"/pairs/*/x0", "/pairs/*/y0", "/pairs/*/x1", "/pairs/*/y1"};
+
+    clearPairs(pairs);
+    pairs->inputArena.reset();
+    InputFile input = InputFile();
+    Arena stringArena = Arena();
+    ParseResult result;
+
+    try
+    {
+        openInputFile(inputFileName, &input, options, &pairs->inputArena);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+    catch (const std::exception &)
+    {
+        return makeParseResult(PARSE_IO_ERROR, NULL, 0);
+    }
+
+    try
+    {
+        Query query;
+        compileQuery(&query, paths, 4);
+        TIME_BANDWIDTH("queryPairs", input.size);
+        reservePairs(pairs, estimatePairsCount(input.data, input.size));
+        for (;;)
+        {
+            QueryColumn columns[4];
+            initQueryColumn(&columns[0], pairs->x0, pairs->capacity);
+            initQueryColumn(&columns[1], pairs->y0, pairs->capacity);
+            initQueryColumn(&columns[2], pairs->x1, pairs->capacity);
+            initQueryColumn(&columns[3], pairs->y1, pairs->capacity);
+            result = runQuery(&query, input.data, input.size, columns, &stringArena);
+            if (!result.ok())
+            {
+                break;
+            }
+
+            u64 count = columns[0].count;
+            if (columns[1].count != count || columns[2].count != count || columns[3].count != count)
+            {
+                result = makeParseResult(PARSE_MISSING_COORDINATES, NULL, 0);
+                break;
+            }
+            if (count <= pairs->capacity)
+            {
+                pairs->count = count;
+                break;
+            }
+            // the guess was short, the columns are sized right the second time
+            reservePairs(pairs, count);
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        result = makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+
+    closeInputFile(&input);
+    if (!result.ok())
+    {
+        clearPairs(pairs);
+    }
+    return result;
+}
+
+// Splits the input in threadCount byte ranges, moves every boundary forward to
+// the '{' of the next record and decodes each range on its own thread into
+// chunks[i]; concatenated in order the chunks hold every pair. The split only
+// depends on the input and threadCount. If any range deviates from the
+// generator's shape everything is decoded again on this thread into chunks[0].
+// Never throws, like parsePairs().
+ParseResult parsePairsParallel(const char *inputFileName, Pairs *chunks, int threadCount, const LoadOptions &options = LoadOptions())
+{
+    for (int i = 0; i < threadCount; i++)
+    {
+        clearPairs(&chunks[i]);
+    }
+    chunks[0].inputArena.reset();
+    InputFile input = InputFile();
+    ParseResult result;
+
+    try
+    {
+        openInputFile(inputFileName, &input, options, &chunks[0].inputArena);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+    catch (const std::exception &)
+    {
+        return makeParseResult(PARSE_IO_ERROR, NULL, 0);
+    }
+
+    try
+    {
+        const char *buffer = input.data;
+        u64 size = input.size;
+        TIME_BANDWIDTH("decodePairsParallel", size);
+
+        std::vector<u64> bounds(threadCount + 1);
+        bounds[0] = 0;
+        bounds[threadCount] = size;
+        for (int i = 1; i < threadCount; i++)
+        {
+            u64 position = size / threadCount * i;
+            if (position < bounds[i - 1] + 1)
+            {
+                position = bounds[i - 1] + 1;
+            }
+            const char *record = position < size ? (const char *)memchr(buffer + position, '{', size - position) : NULL;
+            bounds[i] = record ? record - buffer : size;
+        }
+
+        u64 estimate = estimatePairsCount(buffer, size);
+        std::vector<char> decoded(threadCount, 1);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < threadCount; i++)
+        {
+            if (i > 0 && bounds[i] >= bounds[i + 1])
+            {
+                continue;
+            }
+            threads.emplace_back([&, i]()
+                                 {
+                                     try
+                                     {
+                                         reservePairs(&chunks[i], (u64)((f64)estimate * (bounds[i + 1] - bounds[i]) / size) + 16);
+                                         decoded[i] = parsePairsRange(buffer, size, bounds[i], bounds[i + 1], &chunks[i]);
+                                     }
+                                     catch (...)
+                                     {
+                                         decoded[i] = 0;
+                                     }
+                                 });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+
+        bool specialized = true;
+        for (int i = 0; i < threadCount; i++)
+        {
+            specialized = specialized && decoded[i];
+        }
+
+        if (specialized)
+        {
+            for (int i = 0; i < threadCount; i++)
+            {
+                chunks[i].specialized = true;
+            }
+            result = makeParseResult(PARSE_OK, buffer, 0);
+        }
+        else
+        {
+            for (int i = 0; i < threadCount; i++)
+            {
+                clearPairs(&chunks[i]);
+            }
+            result = decodePairs(buffer, size, &chunks[0]);
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        result = makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+
+    closeInputFile(&input);
+    if (!result.ok())
+    {
+        for (int i = 0; i < threadCount; i++)
+        {
+            clearPairs(&chunks[i]);
+        }
+    }
+    return result;
+}
+
+// Maps a .bin file written by the generator and points the columns into it,
+// nothing is parsed or copied. Never throws: on error the pairs are empty.
+ParseResult loadBinaryPairs(const char *inputFileName, Pairs *pairs, bool verifyChecksum = true, const LoadOptions &options = LoadOptions())
+{
+    clearPairs(pairs);
+    LoadOptions mapOptions = options;
+    mapOptions.mode = LoadOptions::MMAP;
+
+    try
+    {
+        openInputFile(inputFileName, &pairs->binary, mapOptions, &pairs->inputArena);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+    catch (const std::exception &)
+    {
+        return makeParseResult(PARSE_IO_ERROR, NULL, 0);
+    }
+    TIME_BANDWIDTH("loadBinaryPairs", pairs->binary.size);
+
+    BinaryPairsHeader header;
+    if (pairs->binary.size < sizeof(header))
+    {
+        clearPairs(pairs);
+        return makeParseResult(PARSE_INVALID_BINARY, NULL, 0);
+    }
+    memcpy(&header, pairs->binary.data, sizeof(header));
+    if (memcmp(header.magic, binaryPairsMagic, sizeof(binaryPairsMagic)) != 0 || header.version != binaryPairsVersion ||
+        header.layout != BINARY_LAYOUT_SOA || header.count > pairs->binary.size || getBinaryPairsSize(header.count) != pairs->binary.size)
+    {
+        clearPairs(pairs);
+        return makeParseResult(PARSE_INVALID_BINARY, NULL, 0);
+    }
+
+    f64 *columns[4];
+    PairsChecksum checksum = PairsChecksum();
+    for (int i = 0; i < 4; i++)
+    {
+        // the mapping is read-only, the columns are only read
+        columns[i] = (f64 *)(pairs->binary.data + getBinaryColumnOffset(header.count, i));
+        if (verifyChecksum)
+        {
+            addToPairsChecksum(&checksum, i, columns[i], header.count);
+        }
+    }
+    if (verifyChecksum && getPairsChecksum(&checksum) != header.checksum)
+    {
+        clearPairs(pairs);
+        return makeParseResult(PARSE_CHECKSUM_MISMATCH, NULL, 0);
+    }
+
+    pairs->x0 = columns[0];
+    pairs->y0 = columns[1];
+    pairs->x1 = columns[2];
+    pairs->y1 = columns[3];
+    pairs->count = header.count;
+    pairs->capacity = header.count;
+    pairs->specialized = true;
+    return makeParseResult(PARSE_OK, NULL, 0);
+}
+
+// Why the stream stopped at parser->current, in a window starting at
+// windowOffset of the input: a number that isn't one, the input ending inside
+// the document, or else a shape the generic parser may still accept. Only the
+// offset is known here, see locateStreamError().
+inline ParseResult getStreamDeviation(const Parser *parser, u64 windowOffset, bool last)
+{
+    ParseResult result = ParseResult();
+    result.status = PARSE_UNEXPECTED_SHAPE;
+    u64 current = parser->current < parser->size ? parser->current : parser->size;
+    if (parser->status != PARSE_OK)
+    {
+        result.status = parser->status;
+        result.offset = windowOffset + parser->errorOffset;
+    }
+    else if (last && !memchr(parser->buffer + current, ',', parser->size - current) &&
+             !memchr(parser->buffer + current, ':', parser->size - current) &&
+             !memchr(parser->buffer + current, '}', parser->size - current) &&
+             !memchr(parser->buffer + current, ']', parser->size - current))
+    {
+        // nothing left could close what's open, at most a cut off token
+        result.status = PARSE_UNEXPECTED_END;
+        result.offset = windowOffset + parser->size;
+        const char *rest = parser->buffer + current;
+        if (*rest == '"' && !memchr(rest + 1, '"', parser->size - current - 1))
+        {
+            result.status = PARSE_UNTERMINATED_STRING;
+            result.offset = windowOffset + current;
+        }
+    }
+    return result;
+}
+
+// The stream never holds the whole input, so the line and column of an error
+// are counted once it happened, from the file
+inline ParseResult locateStreamError(const char *inputFileName, const ParseResult &result)
+{
+    if (result.ok() || result.status == PARSE_UNEXPECTED_SHAPE || result.line != 0)
+    {
+        return result;
+    }
+    LoadOptions options = LoadOptions();
+    options.mode = LoadOptions::MMAP;
+    Arena arena = Arena();
+    InputFile input = InputFile();
+    ParseResult located = result;
+    try
+    {
+        openInputFile(inputFileName, &input, options, &arena);
+        if (result.offset <= input.size)
+        {
+            located = makeParseResult(result.status, input.data, result.offset);
+        }
+    }
+    catch (const std::exception &)
+    {
+    }
+    closeInputFile(&input);
+    return located;
+}
+
+// Decodes the generator's shape from a StreamReader without ever holding the
+// whole input: pairs is a batch of at most batchSize pairs handed to
+// onBatch(pairs) whenever it fills up, and once more at the end. Whatever a
+// block ends with that isn't a complete record is carried in front of the
+// next block. Returns PARSE_UNEXPECTED_SHAPE when the input isn't in the
+// generator's shape, and errors without their line, onBatch may have been
+// called already by then.
+template <typename Callback>
+ParseResult streamPairs(StreamReader *reader, Pairs *pairs, u64 batchSize, Callback onBatch)
+{
+    enum
+    {
+        HEADER,
+        FIRST_RECORD,
+        RECORD,
+        SEPARATOR,
+        END,
+        DONE,
+    } state = HEADER;
+
+    clearPairs(pairs);
+    reservePairs(pairs, batchSize);
+
+    StreamBlock *block = acquireStreamBlock(reader);
+    const char *window = block->data;
+    u64 windowSize = block->size;
+    u64 windowOffset = 0;
+    while (true)
+    {
+        TIME_BANDWIDTH("streamPairs", block->size);
+        Parser parser = Parser();
+        parser.buffer = window;
+        parser.size = windowSize;
+        parser.current = 0;
+
+        // stops at the first token that may continue in the next block
+        while (state != DONE)
+        {
+            skipPairsWhitespace(&parser);
+            if (parser.current >= windowSize)
+            {
+                break;
+            }
+
+            if (state == HEADER)
+            {
+                const char *header = (const char *)memchr(window + parser.current, '[', windowSize - parser.current);
+                if (!header && !block->last)
+                {
+                    break;
+                }
+                if (!expectPairsCharacter(&parser, '{'))
+                {
+                    return getStreamDeviation(&parser, windowOffset, false);
+                }
+                if (!expectPairsKey(&parser, "\"pairs\"", 7) || !expectPairsCharacter(&parser, '['))
+                {
+                    return getStreamDeviation(&parser, windowOffset, block->last);
+                }
+                state = FIRST_RECORD;
+            }
+            else if (state == FIRST_RECORD && peak(&parser) == ']')
+            {
+                parser.current++;
+                state = END;
+            }
+            else if (state == FIRST_RECORD || state == RECORD)
+            {
+                // numbers end at the '}', so a record with its '}' is complete
+                if (!block->last && !memchr(window + parser.current, '}', windowSize - parser.current))
+                {
+                    break;
+                }
+                if (!parsePairsRecord(&parser, pairs))
+                {
+                    return getStreamDeviation(&parser, windowOffset, block->last);
+                }
+                if (pairs->count == batchSize)
+                {
+                    onBatch(pairs);
+                    pairs->count = 0;
+                }
+                state = SEPARATOR;
+            }
+            else if (state == SEPARATOR)
+            {
+                char c = next(&parser);
+                if (c == ',')
+                {
+                    state = RECORD;
+                }
+                else if (c == ']')
+                {
+                    state = END;
+                }
+                else
+                {
+                    return getStreamDeviation(&parser, windowOffset, block->last);
+                }
+            }
+            else if (state == END)
+            {
+                if (next(&parser) != '}')
+                {
+                    return getStreamDeviation(&parser, windowOffset, block->last);
+                }
+                state = DONE;
+            }
+        }
+
+        if (block->last)
+        {
+            skipPairsWhitespace(&parser);
+            if (state != DONE)
+            {
+                return getStreamDeviation(&parser, windowOffset, true);
+            }
+            if (parser.current != windowSize)
+            {
+                ParseResult result = ParseResult();
+                result.status = PARSE_TRAILING_CHARACTERS;
+                result.offset = windowOffset + parser.current;
+                return result;
+            }
+            break;
+        }
+
+        // move the unparsed tail in front of the next block's data; the
+        // generator's records are much shorter than the carry
+        u64 tail = windowSize - parser.current;
+        if (tail > reader->options.carryCapacity)
+        {
+            return getStreamDeviation(&parser, windowOffset, false);
+        }
+        StreamBlock *nextBlock = acquireStreamBlock(reader);
+        memcpy(nextBlock->data - tail, window + parser.current, tail);
+        releaseStreamBlock(reader);
+        block = nextBlock;
+        windowOffset += parser.current;
+        window = block->data - tail;
+        windowSize = tail + block->size;
+    }
+
+    if (pairs->count > 0)
+    {
+        onBatch(pairs);
+        pairs->count = 0;
+    }
+    pairs->specialized = true;
+    return ParseResult();
+}
+
+// Streams a file through streamPairs(). Malformed input is reported in the
+// result, with PARSE_UNEXPECTED_SHAPE when it's only not in the generator's
+// shape and the whole input has to go through parsePairs() instead.
+// Exceptions only come from onBatch.
+template <typename Callback>
+ParseResult streamPairsFile(const char *inputFileName, Pairs *pairs, u64 batchSize, Callback onBatch, const StreamOptions &options = StreamOptions())
+{
+    StreamReader reader;
+    ParseResult result = ParseResult();
+    std::exception_ptr batchError;
+    try
+    {
+        openStreamReader(inputFileName, &reader, options);
+        result = streamPairs(&reader, pairs, batchSize, [&](Pairs *batch)
+                             {
+            try
+            {
+                onBatch(batch);
+            }
+            catch (...)
+            {
+                batchError = std::current_exception();
+                throw;
+            } });
+    }
+    catch (const std::bad_alloc &)
+    {
+        result = makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+    catch (const std::exception &)
+    {
+        result = makeParseResult(PARSE_IO_ERROR, NULL, 0);
+    }
+    catch (...)
+    {
+        // onBatch's, rethrown below
+    }
+    closeStreamReader(&reader);
+    if (batchError)
+    {
+        std::rethrow_exception(batchError);
+    }
+    return locateStreamError(inputFileName, result);
+}
+
+struct PipelineOptions
+{
+    StreamOptions stream;
+    // pairs per batch, and how many batches the parser can fill ahead
+    u64 batchSize = 4096;
+    int batchCount = 4;
+    // one core per stage, when there are at least three to choose from
+    bool pin = true;
+};
+
+// Where each stage of a pipeline spent its time, in nanoseconds. A stage is
+// busy when it isn't waiting on one of its rings: the wall time can't go
+// below the busiest one, and the others wait on it.
+struct PipelineStats
+{
+    u64 batches;
+    u64 wallNanoseconds;
+    // read: waiting for a buffer the parser released
+    u64 readBusy;
+    RingStalls readStalls;
+    // parse: waiting for a filled buffer, then for a free batch
+    u64 parseBusy;
+    RingStalls parseInputStalls;
+    RingStalls parseOutputStalls;
+    // compute: waiting for a batch
+    u64 computeBusy;
+    RingStalls computeStalls;
+    bool pinned;
+};
+
+// First three cores this process may run on, false if there aren't as many
+inline bool getPipelineCores(int cores[3])
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) < 3)
+    {
+        return false;
+    }
+    int found = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && found < 3; cpu++)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+        {
+            cores[found++] = cpu;
+        }
+    }
+    return found == 3;
+}
+
+inline void pinThread(pthread_t thread, int core)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+// streamPairsFile() in three stages connected by lock-free rings: the stream
+// reader's thread reads blocks, the calling thread parses them into batches,
+// and a compute thread hands every batch to onBatch(pairs). A batch is parsed
+// into free columns while the previous ones are computed, so the stages
+// overlap and the wall time tends towards the slowest one. Returns what
+// streamPairsFile() would, onBatch may have been called already by then, and
+// an exception from onBatch stops the other stages before it's rethrown here.
+template <typename Callback>
+ParseResult pipelinePairsFile(const char *inputFileName, Callback onBatch, const PipelineOptions &options, PipelineStats *stats)
+{
+    *stats = PipelineStats();
+    u64 start = readOsTimer();
+
+    SpscRing ring;
+    initSpscRing(&ring, options.batchCount);
+    Pairs *batches = new Pairs[options.batchCount];
+    for (int i = 0; i < options.batchCount; i++)
+    {
+        reservePairs(&batches[i], options.batchSize);
+    }
+
+    // an exception in onBatch closes the ring, which stops the parser
+    std::exception_ptr computeError;
+    std::thread compute([&]()
+                        {
+        u64 computeStart = readOsTimer();
+        u64 i;
+        try
+        {
+            while (acquireRingSlot(&ring, &i, &stats->computeStalls))
+            {
+                onBatch(&batches[i % options.batchCount]);
+                releaseRingSlot(&ring);
+            }
+        }
+        catch (...)
+        {
+            computeError = std::current_exception();
+            closeSpscRing(&ring);
+        }
+        stats->computeBusy = readOsTimer() - computeStart - stats->computeStalls.nanoseconds; });
+
+    int cores[3];
+    cpu_set_t callerCores;
+    stats->pinned = options.pin && getPipelineCores(cores) &&
+                    pthread_getaffinity_np(pthread_self(), sizeof(callerCores), &callerCores) == 0;
+    if (stats->pinned)
+    {
+        pinThread(pthread_self(), cores[1]);
+        pinThread(compute.native_handle(), cores[2]);
+    }
+
+    StreamReader reader;
+    Pairs pairs = Pairs();
+    ParseResult result = ParseResult();
+    try
+    {
+        openStreamReader(inputFileName, &reader, options.stream);
+        if (stats->pinned)
+        {
+            pinThread(reader.thread.native_handle(), cores[0]);
+        }
+        // the parsed columns are swapped with those of a free batch
+        result = streamPairs(&reader, &pairs, options.batchSize, [&](Pairs *parsed)
+                              {
+            u64 i;
+            if (!reserveRingSlot(&ring, &i, &stats->parseOutputStalls))
+            {
+                throw std::runtime_error("Pipeline stopped.");
+            }
+            Pairs *batch = &batches[i % options.batchCount];
+            std::swap(batch->x0, parsed->x0);
+            std::swap(batch->y0, parsed->y0);
+            std::swap(batch->x1, parsed->x1);
+            std::swap(batch->y1, parsed->y1);
+            batch->count = parsed->count;
+            stats->batches++;
+            publishRingSlot(&ring); });
+    }
+    catch (const std::bad_alloc &)
+    {
+        result = makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+    catch (const std::exception &)
+    {
+        // also "Pipeline stopped." after a compute failure, rethrown below
+        result = makeParseResult(PARSE_IO_ERROR, NULL, 0);
+    }
+    closeSpscRing(&ring);
+    compute.join();
+    closeStreamReader(&reader);
+    if (stats->pinned)
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(callerCores), &callerCores);
+    }
+
+    stats->wallNanoseconds = readOsTimer() - start;
+    stats->readBusy = reader.readNanoseconds;
+    stats->readStalls = reader.fullStalls;
+    stats->parseInputStalls = reader.emptyStalls;
+    stats->parseBusy = stats->wallNanoseconds - reader.emptyStalls.nanoseconds - stats->parseOutputStalls.nanoseconds;
+    delete[] batches;
+    if (computeError)
+    {
+        std::rethrow_exception(computeError);
+    }
+    return locateStreamError(inputFileName, result);
+}
+
+void printPipelineStats(const PipelineStats *stats)
+{
+    const char *names[3] = {"read", "parse", "compute"};
+    u64 busy[3] = {stats->readBusy, stats->parseBusy, stats->computeBusy};
+    int slowest = 0;
+    for (int i = 1; i < 3; i++)
+    {
+        slowest = busy[i] > busy[slowest] ? i : slowest;
+    }
+
+    printf("Pipeline: %llu batches in %.3f ms%s\n", (unsigned long long)stats->batches,
+           stats->wallNanoseconds / 1e6, stats->pinned ? ", one core per stage" : "");
+    printf("  read     busy %10.3f ms, waited %10.3f ms for a free buffer (%llu times)\n",
+           busy[0] / 1e6, stats->readStalls.nanoseconds / 1e6, (unsigned long long)stats->readStalls.count);
+    printf("  parse    busy %10.3f ms, waited %10.3f ms for input (%llu times), %.3f ms for a free batch (%llu times)\n",
+           busy[1] / 1e6, stats->parseInputStalls.nanoseconds / 1e6, (unsigned long long)stats->parseInputStalls.count,
+           stats->parseOutputStalls.nanoseconds / 1e6, (unsigned long long)stats->parseOutputStalls.count);
+    printf("  compute  busy %10.3f ms, waited %10.3f ms for a batch (%llu times)\n",
+           busy[2] / 1e6, stats->computeStalls.nanoseconds / 1e6, (unsigned long long)stats->computeStalls.count);
+    printf("  bottleneck: %s\n", names[slowest]);
+}
@@ -1,43 +1,146 @@
+#pragma once
+
 #include <stdio.h>
 #include "ArrayList.h"
+#include "Arena.h"
+#include "InputFile.h"
+#include "StructuralIndex.h"
+#include "NumberParser.h"
+#include "JsonWriter.h"
+#include "Shapes.h"
+#include "ParseStatus.h"
 #include <string.h>
 #include <exception>
-#include <charconv>
 
 typedef double f64;
 
 struct Json;
+struct Parser;
+struct ParseResult;
+struct String;
 struct Value;
 struct Object;
 struct Member;
 struct Array;
 
-char next(char *buffer, int *current);
-char peak(char *buffer, int *current);
-char nextPeak(char *buffer, int *current);
-Value getElement(char *buffer, int *current);
-Value getValue(char *buffer, int *current);
-void escapeWhitespaces(char *buffer, int *current);
-Object *getObject(char *buffer, int *current);
-void getMembers(char *buffer, int *current, ArrayList<Member> *members);
-Member getMember(char *buffer, int *current);
-char *getString(char *buffer, int *current);
-Array *getArray(char *buffer, int *current);
-void getValues(char *buffer, int *current, ArrayList<Value> *values);
-Value &getByIndex(ArrayList<Member> &elements, int index);
-Value &getByIndex(ArrayList<Value> &elements, int index);
-Value &getByName(ArrayList<Member> &elements, const char *name);
+char next(Parser *parser);
+char peak(Parser *parser);
+char nextPeak(Parser *parser);
+Value getElement(Parser *parser);
+Value getValue(Parser *parser);
+void escapeWhitespaces(Parser *parser);
+Object *getObject(Parser *parser);
+void getMembers(Parser *parser, Object *object);
+Member getMember(Parser *parser);
+String getRawString(Parser *parser);
+String getString(Parser *parser);
+ParseStatus unescapeString(const char *source, u64 length, Arena *arena, String *string);
+int getHexDigit(char c);
+int getCodeUnit(const char *source, u64 *i, u64 length);
+Array *getArray(Parser *parser);
+void getValues(Parser *parser, ArrayList<Value> *values);
+Value &getByIndex(ArrayList<Member> &elements, size_t index);
+Value &getByIndex(ArrayList<Value> &elements, size_t index);
+Value &getByName(Object *object, const char *name);
+Value &getByName(Object *object, MemberKey &key);
+void writeValue(JsonWriter *writer, Value &value);
 bool isDigit(char c);
-f64 getNumber(char *buffer, int *current);
+bool isNumberStart(char c);
+f64 getNumber(Parser *parser);
+bool getLiteral(Parser *parser, const char *literal);
+
+// Cursor of the second parsing stage. The structural index marks the bytes
+// worth stopping at (see buildStructuralIndex) so whitespace and string
+// contents are skipped without looking at them.
+struct Parser
+{
+    const char *buffer;
+    u64 size;
+    u64 current;
+    StructuralIndex *index;
+    Arena *arena;
+    // where objects get their shape, only needed to build a tree
+    ShapeTable *shapes;
+    // first error and where it was found, see failParse()
+    ParseStatus status;
+    u64 errorOffset;
+};
+
+void initParser(Parser *parser, const char *buffer, u64 size, StructuralIndex *index, Arena *arena)
+{
+    initStructuralIndex(index, buffer, size);
+    parser->buffer = buffer;
+    parser->size = size;
+    parser->current = 0;
+    parser->index = index;
+    parser->arena = arena;
+    parser->shapes = NULL;
+    parser->status = PARSE_OK;
+    parser->errorOffset = 0;
+}
+
+// Errors don't unwind: the first one is recorded and the cursor jumps to the
+// end of the input, where the zero padding ends every loop of the grammar, so
+// each level returns after a peek or two. Nothing on the parsing path throws.
+__attribute__((cold, noinline)) void failParse(Parser *parser, ParseStatus status, u64 offset)
+{
+    if (parser->status == PARSE_OK)
+    {
+        // stopped by the zero padding: the input ended before the document
+        parser->status = offset >= parser->size && status != PARSE_DOCUMENT_TOO_LARGE ? PARSE_UNEXPECTED_END : status;
+        parser->errorOffset = offset < parser->size ? offset : parser->size;
+    }
+    parser->current = parser->size;
+}
 
+inline void failParse(Parser *parser, ParseStatus status)
+{
+    failParse(parser, status, parser->current);
+}
+
+// Pointer + length view. Points straight into the input buffer unless the
+// string had escape sequences, in which case it points to an arena copy.
+struct String
+{
+    const char *data;
+    u64 length;
+
+    bool equals(const char *other, u64 otherLength) const
+    {
+        return length == otherLength && memcmp(data, other, length) == 0;
+    }
+
+    bool operator==(const char *other) const
+    {
+        return equals(other, strlen(other));
+    }
+
+    bool operator!=(const char *other) const
+    {
+        return !equals(other, strlen(other));
+    }
+};
+
+// Member names point to the interned copy of their key, members[i] is the
+// value of shape->keys[i]
 struct Object
 {
     ArrayList<Member> members;
+    const Shape *shape;
+
+    Object(Arena *arena) : members(arena)
+    {
+        shape = NULL;
+    }
 };
 
 struct Array
 {
     ArrayList<Value> values;
+
+    Array(Arena *arena) : values(arena)
+    {
+    }
 };
 
 struct Value
@@ -55,13 +158,13 @@ struct Value
     {
         Object *object;
         Array *array;
-        char *string;
+        String string;
         f64 number;
         bool boolean;
         bool null;
     };
 
-    int size()
+    size_t size()
     {
         if (type == OBJECT)
         {
@@ -97,7 +200,19 @@ struct Value
     {
         if (type == OBJECT)
         {
-            return getByName(object->members, name);
+            return getByName(object, name);
+        }
+        else
+        {
+            throw std::runtime_error("Not an object");
+        }
+    }
+
+    Value &operator[](MemberKey &key)
+    {
+        if (type == OBJECT)
+        {
+            return getByName(object, key);
         }
         else
         {
@@ -108,19 +223,61 @@ struct Value
 
 struct Member
 {
-    char *name;
+    String name;
     Value value;
 };
 
+// Every node, string and list buffer of the document lives in the arena, so
+// dropping a document is O(1) and clear() keeps the memory for the next parse.
+// The input stays loaded (in the arena or mapped) since strings are views into it.
 struct Json
 {
     Value value;
+    Arena arena;
+    InputFile input;
+
+    Json()
+    {
+        value.type = Value::NULL_VALUE;
+        value.null = true;
+    }
+
+    Json(Json &&other) : arena(std::move(other.arena))
+    {
+        value = other.value;
+        input = other.input;
+        other.value.type = Value::NULL_VALUE;
+        other.input = InputFile();
+    }
+
+    Json &operator=(Json &&other)
+    {
+        closeInputFile(&input);
+        arena = std::move(other.arena);
+        value = other.value;
+        input = other.input;
+        other.value.type = Value::NULL_VALUE;
+        other.input = InputFile();
+        return *this;
+    }
+
     ~Json()
     {
-        deleteRecursive(value);
+        closeInputFile(&input);
+    }
+
+    Json &operator=(const Json &other) = delete;
+    Json(const Json &other) = delete;
+
+    void clear()
+    {
+        closeInputFile(&input);
+        arena.reset();
+        value.type = Value::NULL_VALUE;
+        value.null = true;
     }
 
-    int size()
+    size_t size()
     {
         if (value.type == Value::OBJECT)
         {
@@ -136,51 +293,39 @@ struct Json
         }
     }
 
-    void deleteRecursive(Value &value)
+    Value &operator[](int index)
     {
         if (value.type == Value::OBJECT)
         {
-            for (int i = 0; i < value.object->members.getSize(); i++)
-            {
-                deleteRecursive(value.object->members[i].value);
-            }
-            delete value.object;
+            return getByIndex(value.object->members, index);
         }
         else if (value.type == Value::ARRAY)
         {
-            for (int i = 0; i < value.array->values.getSize(); i++)
-            {
-                deleteRecursive(value.array->values[i]);
-            }
-            delete value.array;
+            return getByIndex(value.array->values, index);
         }
-        else if (value.type == Value::STRING)
+        else
         {
-            delete[] value.string;
+            throw std::runtime_error("Not an array or object");
         }
     }
 
-    Value &operator[](int index)
+    Value &operator[](const char *name)
     {
         if (value.type == Value::OBJECT)
         {
-            return getByIndex(value.object->members, index);
-        }
-        else if (value.type == Value::ARRAY)
-        {
-            return getByIndex(value.array->values, index);
+            return getByName(value.object, name);
         }
         else
         {
-            throw std::runtime_error("Not an array or object");
+            throw std::runtime_error("Not an object");
         }
     }
 
-    Value &operator[](const char *name)
+    Value &operator[](MemberKey &key)
     {
         if (value.type == Value::OBJECT)
         {
-            return getByName(value.object->members, name);
+            return getByName(value.object, key);
         }
         else
         {
@@ -188,208 +333,165 @@ struct Json
         }
     }
 
-    char *print()
+    void write(JsonWriter *writer)
     {
-        int indent = 0;
-        return printRecursive(value, &indent);
+        writeValue(writer, value);
     }
 
-    char *printRecursive(Value &value, int *indent)
+    // NUL terminated text of the document, in the arena: valid until the
+    // document is cleared or parsed again
+    char *print(bool pretty = true)
     {
-        char *buffer = new char[1024];
-
-        if (value.type == Value::OBJECT)
-        {
-
-            if (value.object->members.getSize() == 0)
-            {
-                buffer[0] = '{';
-                buffer[1] = '}';
-                buffer[2] = '\0';
-                return buffer;
-            }
-
-            buffer[0] = '{';
-            buffer[1] = '\n';
-            buffer[2] = '\0';
-            *indent += 1;
-
-            for (int i = 0; i < value.object->members.getSize(); i++)
-            {
-                for (int j = 0; j < *indent; j++)
-                {
-                    strcat(buffer, "    ");
-                }
-                strcat(buffer, "\"");
-                strcat(buffer, value.object->members[i].name);
-                strcat(buffer, "\"");
+        JsonWriter writer = JsonWriter();
+        initJsonWriter(&writer, pretty);
+        write(&writer);
+        char *text = arena.allocateArray<char>(writer.size + 1);
+        memcpy(text, writer.buffer, writer.size);
+        text[writer.size] = '\0';
+        return text;
+    }
 
-                strcat(buffer, ": ");
-                strcat(buffer, printRecursive(value.object->members[i].value, indent));
-                if (i < value.object->members.getSize() - 1)
-                {
-                    strcat(buffer, ",\n");
-                }
-            }
-            *indent -= 1;
-            strcat(buffer, "\n");
-            for (int j = 0; j < *indent; j++)
-            {
-                strcat(buffer, "    ");
-            }
-            strcat(buffer, "}");
-            return buffer;
-        }
-        else if (value.type == Value::ARRAY)
-        {
-            buffer[0] = '[';
-            buffer[1] = '\0';
-            for (int i = 0; i < value.array->values.getSize(); i++)
-            {
-                strcat(buffer, printRecursive(value.array->values[i], indent));
-                if (i < value.array->values.getSize() - 1)
-                {
-                    strcat(buffer, ", ");
-                }
-            }
-            strcat(buffer, "]");
-            return buffer;
-        }
-        else if (value.type == Value::STRING)
-        {
-            buffer[0] = '"';
-            buffer[1] = '\0';
-            strcat(buffer, value.string);
-            strcat(buffer, "\"");
-            return buffer;
-        }
-        else if (value.type == Value::NUMBER)
-        {
-            sprintf(buffer, "%f", value.number);
-            return buffer;
-        }
-        else if (value.type == Value::BOOLEAN)
-        {
-            if (value.boolean)
-            {
-                strcpy(buffer, "true");
-            }
-            else
-            {
-                strcpy(buffer, "false");
-            }
-            return buffer;
-        }
-        else if (value.type == Value::NULL_VALUE)
-        {
-            strcpy(buffer, "null");
-            return buffer;
-        }
-        else
-        {
-            throw std::runtime_error("Unknown value type");
-        }
+    // Streams the document to fd through a bounded buffer
+    void print(int fd, bool pretty = true)
+    {
+        JsonWriter writer = JsonWriter();
+        initJsonWriter(&writer, pretty, fd);
+        write(&writer);
+        flushJsonWriter(&writer);
     }
 };
 
-Json parse(const char *inputFileName)
+// Parses into an existing document, reusing the memory of its previous
+// content. Never throws: on error the document is left null and the result
+// says what went wrong and where.
+ParseResult tryParse(const char *inputFileName, Json &json, const LoadOptions &options = LoadOptions()) noexcept
 {
-    Json json = Json();
+    json.clear();
 
     try
     {
-        // Open input file
-        FILE *inputFile = fopen(inputFileName, "rb");
-        if (!inputFile)
-        {
-            throw std::runtime_error("Failed to open input file.");
-        }
-
-        // Get the file size
-        fseek(inputFile, 0, SEEK_END);
-        long inputFileSize = ftell(inputFile);
-        fseek(inputFile, 0, SEEK_SET);
-
-        // Create a buffer to hold the file contents
-        char *inputFileBuffer = new char[inputFileSize];
+        // Load the file, it stays around as long as the document
+        openInputFile(inputFileName, &json.input, options, &json.arena);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+    catch (const std::exception &)
+    {
+        return makeParseResult(PARSE_IO_ERROR, NULL, 0);
+    }
 
-        // Read the file into the buffer
-        size_t bytesRead = fread(inputFileBuffer, 1, inputFileSize, inputFile);
-        if (bytesRead != inputFileSize)
+    ParseStatus status;
+    u64 offset;
+    try
+    {
+        TIME_BANDWIDTH("parse", json.input.size);
+        StructuralIndex index;
+        ShapeTable shapes;
+        initShapeTable(&shapes, &json.arena);
+        Parser parser;
+        initParser(&parser, json.input.data, json.input.size, &index, &json.arena);
+        parser.shapes = &shapes;
+        json.value = getElement(&parser);
+        if (parser.status == PARSE_OK && parser.current != parser.size)
         {
-            throw std::runtime_error("Failed to read input file.");
+            failParse(&parser, PARSE_TRAILING_CHARACTERS);
         }
+        status = parser.status;
+        offset = parser.errorOffset;
+    }
+    catch (const std::bad_alloc &)
+    {
+        status = PARSE_OUT_OF_MEMORY;
+        offset = 0;
+    }
 
-        int current = 0;
-        json.value = getElement(inputFileBuffer, &current);
-
-        delete[] inputFileBuffer;
-        fclose(inputFile);
+    if (status != PARSE_OK)
+    {
+        json.value = Value();
+        json.value.type = Value::NULL_VALUE;
+        json.value.null = true;
     }
-    catch (const std::exception &e)
+    return makeParseResult(status, json.input.data, offset);
+}
+
+// Throwing version of tryParse(), the message has the position of the error
+void parse(const char *inputFileName, Json &json, const LoadOptions &options = LoadOptions())
+{
+    ParseResult result = tryParse(inputFileName, json, options);
+    if (!result.ok())
     {
-        std::cout << "Exception occurred: " << e.what() << std::endl;
+        char message[128];
+        formatParseResult(result, message, sizeof(message));
+        throw std::runtime_error(message);
     }
+}
 
+Json parse(const char *inputFileName, const LoadOptions &options = LoadOptions())
+{
+    Json json = Json();
+    parse(inputFileName, json, options);
     return json;
 }
 
-char next(char *buffer, int *current)
+char next(Parser *parser)
 {
-    return buffer[(*current)++];
+    return parser->buffer[parser->current++];
 }
 
-char peak(char *buffer, int *current)
+char peak(Parser *parser)
 {
-    return buffer[*current];
+    return parser->buffer[parser->current];
 }
 
-char nextPeak(char *buffer, int *current)
+char nextPeak(Parser *parser)
 {
-    return buffer[*current + 1];
+    return parser->buffer[parser->current + 1];
 }
 
-Value getElement(char *buffer, int *current)
+Value getElement(Parser *parser)
 {
-    escapeWhitespaces(buffer, current);
-    Value value = getValue(buffer, current);
-    escapeWhitespaces(buffer, current);
+    TIME_FUNCTION;
+    escapeWhitespaces(parser);
+    Value value = getValue(parser);
+    escapeWhitespaces(parser);
 
     return value;
 }
 
-Value getValue(char *buffer, int *current)
+Value getValue(Parser *parser)
 {
     Value value = Value();
-    char c = next(buffer, current);
+    char c = next(parser);
     switch (c)
     {
     case '{':
         value.type = Value::OBJECT;
-        escapeWhitespaces(buffer, current);
-        value.object = getObject(buffer, current);
-        escapeWhitespaces(buffer, current);
+        escapeWhitespaces(parser);
+        value.object = getObject(parser);
+        escapeWhitespaces(parser);
         break;
     case '[':
         value.type = Value::ARRAY;
-        escapeWhitespaces(buffer, current);
-        value.array = getArray(buffer, current);
-        escapeWhitespaces(buffer, current);
+        escapeWhitespaces(parser);
+        value.array = getArray(parser);
+        escapeWhitespaces(parser);
         break;
     case '"':
     {
-        char *string = getString(buffer, current);
-        if (strcmp(string, "true") == 0)
+        String string = getString(parser);
+        if (string == "true")
         {
             value.type = Value::BOOLEAN;
             value.boolean = true;
         }
-        else if (strcmp(string, "false") == 0)
+        else if (string == "false")
         {
             value.type = Value::BOOLEAN;
             value.boolean = false;
         }
-        else if (strcmp(string, "null") == 0)
+        else if (string == "null")
         {
             value.type = Value::NULL_VALUE;
             value.null = true;
@@ -401,15 +503,28 @@ Value getValue(char *buffer, int *current)
         }
         break;
     }
+    case 't':
+    case 'f':
+        value.type = Value::BOOLEAN;
+        value.boolean = c == 't';
+        getLiteral(parser, value.boolean ? "true" : "false");
+        break;
+    case 'n':
+        value.type = Value::NULL_VALUE;
+        value.null = true;
+        getLiteral(parser, "null");
+        break;
     default:
-        if (isDigit(c))
+        if (isNumberStart(c))
         {
             value.type = Value::NUMBER;
-            value.number = getNumber(buffer, current);
+            value.number = getNumber(parser);
         }
         else
         {
-            throw std::runtime_error("Unexpected character");
+            failParse(parser, PARSE_UNEXPECTED_CHARACTER, parser->current - 1);
+            value.type = Value::NULL_VALUE;
+            value.null = true;
         }
 
         break;
@@ -418,201 +533,661 @@ Value getValue(char *buffer, int *current)
     return value;
 }
 
-void escapeWhitespaces(char *buffer, int *current)
+// Anything that isn't whitespace is left alone, so garbage right after a
+// token still reaches the checks of the caller
+void escapeWhitespaces(Parser *parser)
 {
-    char c = next(buffer, current);
-    while (c == ' ' || c == '\n' || c == '\t' || c == '\r')
+    char c = peak(parser);
+    if (c == ' ' || c == '\n' || c == '\t' || c == '\r')
     {
-        c = next(buffer, current);
+        parser->current = nextStructural(parser->index, parser->current);
     }
-    (*current)--;
 }
 
-Object *getObject(char *buffer, int *current)
+Object *getObject(Parser *parser)
 {
-    Object *object = new Object();
-    escapeWhitespaces(buffer, current);
-    if (peak(buffer, current) == '}')
+    Object *object = parser->arena->create<Object>(parser->arena);
+    escapeWhitespaces(parser);
+    if (peak(parser) == '}')
     {
-        next(buffer, current);
+        next(parser);
+        object->shape = parser->shapes->empty;
         return object;
     }
-    getMembers(buffer, current, &object->members);
+    getMembers(parser, object);
 
-    if (peak(buffer, current) != '}')
+    if (peak(parser) != '}')
     {
-        throw std::runtime_error("Expected '}'");
+        failParse(parser, PARSE_EXPECTED_OBJECT_END);
+        return object;
     }
 
-    next(buffer, current);
+    next(parser);
 
     return object;
 }
 
-void getMembers(char *buffer, int *current, ArrayList<Member> *members)
+// Follows the shape transitions as keys come, so objects with the same keys
+// share a shape and their names point to a single copy
+void addMember(Parser *parser, Object *object, Shape **shape)
+{
+    Member member = getMember(parser);
+    if (parser->status != PARSE_OK)
+    {
+        return;
+    }
+    *shape = getNextShape(parser->shapes, *shape, member.name.data, member.name.length);
+    member.name.data = (*shape)->key->data;
+    object->members.add(member);
+}
+
+void getMembers(Parser *parser, Object *object)
 {
-    members->add(getMember(buffer, current));
+    Shape *shape = parser->shapes->empty;
+    addMember(parser, object, &shape);
 
-    while (peak(buffer, current) == ',')
+    while (peak(parser) == ',')
     {
-        next(buffer, current);
-        members->add(getMember(buffer, current));
+        next(parser);
+        addMember(parser, object, &shape);
     }
+
+    finishShape(parser->shapes, shape);
+    object->shape = shape;
 }
 
-Member getMember(char *buffer, int *current)
+Member getMember(Parser *parser)
 {
     Member member = Member();
-    escapeWhitespaces(buffer, current);
-    char c = next(buffer, current);
-    if (c != '"')
+    escapeWhitespaces(parser);
+    if (peak(parser) != '"')
     {
-        throw std::runtime_error("Expected '\"'");
+        failParse(parser, PARSE_EXPECTED_KEY);
+        return member;
     }
-    member.name = getString(buffer, current);
-    escapeWhitespaces(buffer, current);
-    c = next(buffer, current);
-    if (c != ':')
+    next(parser);
+    member.name = getString(parser);
+    escapeWhitespaces(parser);
+    if (peak(parser) != ':')
     {
-        throw std::runtime_error("Expected ':'");
+        failParse(parser, PARSE_EXPECTED_COLON);
+        return member;
     }
-    member.value = getElement(buffer, current);
+    next(parser);
+    member.value = getElement(parser);
 
     return member;
 }
 
-char *getString(char *buffer, int *current)
+// View of the string as written, escape sequences included
+String getRawString(Parser *parser)
 {
-    int i = 0;
+    // the closing quote is the next structural, escaped quotes aren't marked
+    u64 start = parser->current;
+    u64 end = nextStructural(parser->index, start);
+    String string;
+    if (parser->buffer[end] != '"')
+    {
+        failParse(parser, PARSE_UNTERMINATED_STRING, start - 1);
+        string.data = parser->buffer + start;
+        string.length = 0;
+        return string;
+    }
+    parser->current = end + 1;
 
-    int start = *current;
+    string.data = parser->buffer + start;
+    string.length = end - start;
+    return string;
+}
 
-    char c = next(buffer, current);
-    while (c != '"')
+String getString(Parser *parser)
+{
+    String string = getRawString(parser);
+    if (memchr(string.data, '\\', string.length))
     {
-        c = next(buffer, current);
+        ParseStatus status = unescapeString(string.data, string.length, parser->arena, &string);
+        if (status != PARSE_OK)
+        {
+            failParse(parser, status, string.data - parser->buffer - 1);
+        }
     }
+    return string;
+}
 
-    if (c != '"')
+int getHexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
     {
-        throw std::runtime_error("Expected '\"'");
+        return c - '0';
     }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
 
-    char *string = strncpy(new char[(*current) - (start)], buffer + (start), (*current) - (start));
-    string[(*current - 1) - (start)] = '\0';
-    return string;
+// -1 if the four characters aren't hex digits
+int getCodeUnit(const char *source, u64 *i, u64 length)
+{
+    if (*i + 4 > length)
+    {
+        return -1;
+    }
+    int unit = 0;
+    for (int j = 0; j < 4; j++)
+    {
+        int digit = getHexDigit(source[(*i)++]);
+        if (digit < 0)
+        {
+            return -1;
+        }
+        unit = unit * 16 + digit;
+    }
+    return unit;
 }
 
-Array *getArray(char *buffer, int *current)
+// The unescaped string is never longer than the escaped one. string is only
+// set when the escape sequences are all valid.
+ParseStatus unescapeString(const char *source, u64 length, Arena *arena, String *string)
 {
-    Array *array = new Array();
-    escapeWhitespaces(buffer, current);
-    if (peak(buffer, current) == ']')
+    char *destination = arena->allocateArray<char>(length);
+    u64 size = 0;
+    u64 i = 0;
+    while (i < length)
     {
-        next(buffer, current);
+        char c = source[i++];
+        if (c != '\\')
+        {
+            destination[size++] = c;
+            continue;
+        }
+
+        c = source[i++];
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            destination[size++] = c;
+            break;
+        case 'b':
+            destination[size++] = '\b';
+            break;
+        case 'f':
+            destination[size++] = '\f';
+            break;
+        case 'n':
+            destination[size++] = '\n';
+            break;
+        case 'r':
+            destination[size++] = '\r';
+            break;
+        case 't':
+            destination[size++] = '\t';
+            break;
+        case 'u':
+        {
+            int codePoint = getCodeUnit(source, &i, length);
+            if (codePoint < 0)
+            {
+                return PARSE_INVALID_UNICODE_ESCAPE;
+            }
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 1 < length && source[i] == '\\' && source[i + 1] == 'u')
+            {
+                i += 2;
+                int low = getCodeUnit(source, &i, length);
+                if (low < 0)
+                {
+                    return PARSE_INVALID_UNICODE_ESCAPE;
+                }
+                if (low < 0xDC00 || low > 0xDFFF)
+                {
+                    return PARSE_INVALID_SURROGATE_PAIR;
+                }
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+            }
+
+            // encode as UTF-8, at most 4 bytes for the 6 or 12 consumed
+            if (codePoint < 0x80)
+            {
+                destination[size++] = (char)codePoint;
+            }
+            else if (codePoint < 0x800)
+            {
+                destination[size++] = (char)(0xC0 | (codePoint >> 6));
+                destination[size++] = (char)(0x80 | (codePoint & 0x3F));
+            }
+            else if (codePoint < 0x10000)
+            {
+                destination[size++] = (char)(0xE0 | (codePoint >> 12));
+                destination[size++] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                destination[size++] = (char)(0x80 | (codePoint & 0x3F));
+            }
+            else
+            {
+                destination[size++] = (char)(0xF0 | (codePoint >> 18));
+                destination[size++] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+                destination[size++] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                destination[size++] = (char)(0x80 | (codePoint & 0x3F));
+            }
+            break;
+        }
+        default:
+            return PARSE_INVALID_ESCAPE;
+        }
+    }
+
+    string->data = destination;
+    string->length = size;
+    return PARSE_OK;
+}
+
+Array *getArray(Parser *parser)
+{
+    Array *array = parser->arena->create<Array>(parser->arena);
+    escapeWhitespaces(parser);
+    if (peak(parser) == ']')
+    {
+        next(parser);
         return array;
     }
 
-    getValues(buffer, current, &array->values);
+    getValues(parser, &array->values);
 
-    escapeWhitespaces(buffer, current);
+    escapeWhitespaces(parser);
 
-    if (peak(buffer, current) != ']')
+    if (peak(parser) != ']')
     {
-        throw std::runtime_error("Expected ']'");
+        failParse(parser, PARSE_EXPECTED_ARRAY_END);
+        return array;
     }
 
-    next(buffer, current);
+    next(parser);
 
     return array;
 }
 
-void getValues(char *buffer, int *current, ArrayList<Value> *values)
+// Arrays past this many elements are assumed to be the bulk of the document
+static const size_t arrayEstimateThreshold = 1024;
+
+void getValues(Parser *parser, ArrayList<Value> *values)
 {
-    values->add(getValue(buffer, current));
+    u64 start = parser->current;
+    values->add(getValue(parser));
 
-    while (peak(buffer, current) == ',')
+    while (peak(parser) == ',')
     {
-        next(buffer, current);
-        escapeWhitespaces(buffer, current);
-        values->add(getValue(buffer, current));
+        next(parser);
+        escapeWhitespaces(parser);
+        values->add(getValue(parser));
+
+        // guess the final length from the bytes per element so far and the
+        // bytes left, so a big array grows once instead of doubling its way up.
+        // Nested arrays overshoot, which only costs arena space.
+        if (values->getSize() == arrayEstimateThreshold)
+        {
+            u64 elementBytes = (parser->current - start) / arrayEstimateThreshold;
+            if (elementBytes == 0)
+            {
+                elementBytes = 1;
+            }
+            values->reserve(arrayEstimateThreshold + (parser->size - parser->current) / elementBytes);
+        }
     }
 }
 
-Value &getByIndex(ArrayList<Member> &elements, int index)
+Value &getByIndex(ArrayList<Member> &elements, size_t index)
+{
+    return elements.at(index).value;
+}
+
+Value &getByIndex(ArrayList<Value> &elements, size_t index)
 {
-    return elements[index].value;
+    return elements.at(index);
+}
+
+Value &getByName(Object *object, const char *name)
+{
+    int64_t slot = findShapeSlot(object->shape, name, strlen(name));
+    if (slot < 0)
+    {
+        throw std::runtime_error("No such member: \"" + std::string(name) + "\"");
+    }
+    return object->members[slot].value;
 }
 
-Value &getByIndex(ArrayList<Value> &elements, int index)
+Value &getByName(Object *object, MemberKey &key)
 {
-    return elements[index];
+    int64_t slot = findShapeSlot(object->shape, &key);
+    if (slot < 0)
+    {
+        throw std::runtime_error("No such member: \"" + std::string(key.name) + "\"");
+    }
+    return object->members[slot].value;
 }
 
-Value &getByName(ArrayList<Member> &elements, const char *name)
+void writeValue(JsonWriter *writer, Value &value)
 {
-    for (int i = 0; i < elements.getSize(); i++)
+    switch (value.type)
     {
-        if (strcmp(elements[i].name, name) == 0)
+    case Value::OBJECT:
+        writeObjectBegin(writer);
+        for (Member &member : value.object->members)
+        {
+            writeKey(writer, member.name.data, member.name.length);
+            writeValue(writer, member.value);
+        }
+        writeObjectEnd(writer);
+        break;
+    case Value::ARRAY:
+        writeArrayBegin(writer);
+        for (Value &element : value.array->values)
         {
-            return elements[i].value;
+            writeValue(writer, element);
         }
+        writeArrayEnd(writer);
+        break;
+    case Value::STRING:
+        writeString(writer, value.string.data, value.string.length);
+        break;
+    case Value::NUMBER:
+        writeNumber(writer, value.number);
+        break;
+    case Value::BOOLEAN:
+        writeBoolean(writer, value.boolean);
+        break;
+    case Value::NULL_VALUE:
+        writeNull(writer);
+        break;
     }
-    throw std::runtime_error("No such member: \"" + std::string(name) + "\"");
 }
 
 bool isDigit(char c)
 {
-    return c == '-' || (c >= '0' && c <= '9');
+    return c >= '0' && c <= '9';
 }
 
-f64 getNumber(char *buffer, int *current)
+bool isNumberStart(char c)
 {
-    (*current)--;
-    int start = *current;
-    char c = next(buffer, current);
-    while (isDigit(c))
+    return c == '-' || isDigit(c);
+}
+
+f64 getNumber(Parser *parser)
+{
+    // the first character was already consumed by the caller
+    const char *start = parser->buffer + parser->current - 1;
+    f64 number;
+    const char *end = parseNumber(start, &number);
+    if (!end)
     {
-        c = next(buffer, current);
+        failParse(parser, PARSE_INVALID_NUMBER, parser->current - 1);
+        return 0;
     }
-    (*current)--;
+    parser->current = end - parser->buffer;
+    return number;
+}
 
-    if (peak(buffer, current) == '.')
+// Bare true, false and null, the first character was already consumed by the
+// caller. The zero padding ends the compare at the end of the input.
+bool getLiteral(Parser *parser, const char *literal)
+{
+    u64 start = parser->current - 1;
+    for (u64 i = 1; literal[i]; i++)
     {
-        next(buffer, current);
-        c = next(buffer, current);
-        while (isDigit(c))
+        if (parser->buffer[start + i] != literal[i])
         {
-            c = next(buffer, current);
+            failParse(parser, PARSE_UNEXPECTED_CHARACTER, start + i);
+            return false;
         }
-        (*current)--;
+    }
+    parser->current = start + strlen(literal);
+    return true;
+}
+
+// Streaming mode: the same grammar as getValue, but every token is reported to
+// a handler instead of being stored, so no tree is ever built. Override the
+// events you care about, the handler type is a template parameter so the calls
+// are resolved statically. String views are only valid during the call.
+struct SaxHandler
+{
+    void onObjectBegin() {}
+    void onObjectEnd() {}
+    void onArrayBegin() {}
+    void onArrayEnd() {}
+    void onKey(String) {}
+    void onString(String) {}
+    void onNumber(f64) {}
+    void onBoolean(bool) {}
+    void onNull() {}
+};
+
+template <typename Handler>
+void emitValue(Parser *parser, Handler &handler);
+
+template <typename Handler>
+void emitObject(Parser *parser, Handler &handler)
+{
+    handler.onObjectBegin();
+    escapeWhitespaces(parser);
+    if (peak(parser) == '}')
+    {
+        next(parser);
+        handler.onObjectEnd();
+        return;
     }
 
-    if (peak(buffer, current) == 'e' || peak(buffer, current) == 'E')
+    char c = ',';
+    while (c == ',')
     {
-        next(buffer, current);
-        c = peak(buffer, current);
-        if (c == '+' || c == '-')
+        escapeWhitespaces(parser);
+        if (peak(parser) != '"')
         {
-            next(buffer, current);
+            failParse(parser, PARSE_EXPECTED_KEY);
+            return;
         }
-        c = next(buffer, current);
-        while (isDigit(c))
+        next(parser);
+        String key = getString(parser);
+        if (parser->status != PARSE_OK)
         {
-            c = next(buffer, current);
+            return;
         }
-        (*current)--;
+        handler.onKey(key);
+        // unescaped copies only have to live during the callback
+        parser->arena->reset();
+
+        escapeWhitespaces(parser);
+        if (peak(parser) != ':')
+        {
+            failParse(parser, PARSE_EXPECTED_COLON);
+            return;
+        }
+        next(parser);
+        escapeWhitespaces(parser);
+        emitValue(parser, handler);
+        escapeWhitespaces(parser);
+        c = next(parser);
+    }
+
+    if (c != '}')
+    {
+        failParse(parser, PARSE_EXPECTED_OBJECT_END, parser->current - 1);
+        return;
+    }
+    handler.onObjectEnd();
+}
+
+template <typename Handler>
+void emitArray(Parser *parser, Handler &handler)
+{
+    handler.onArrayBegin();
+    escapeWhitespaces(parser);
+    if (peak(parser) == ']')
+    {
+        next(parser);
+        handler.onArrayEnd();
+        return;
+    }
+
+    char c = ',';
+    while (c == ',')
+    {
+        escapeWhitespaces(parser);
+        emitValue(parser, handler);
+        escapeWhitespaces(parser);
+        c = next(parser);
+    }
+
+    if (c != ']')
+    {
+        failParse(parser, PARSE_EXPECTED_ARRAY_END, parser->current - 1);
+        return;
+    }
+    handler.onArrayEnd();
+}
+
+template <typename Handler>
+void emitValue(Parser *parser, Handler &handler)
+{
+    char c = next(parser);
+    switch (c)
+    {
+    case '{':
+        emitObject(parser, handler);
+        break;
+    case '[':
+        emitArray(parser, handler);
+        break;
+    case '"':
+    {
+        String string = getString(parser);
+        if (parser->status != PARSE_OK)
+        {
+            return;
+        }
+        if (string == "true")
+        {
+            handler.onBoolean(true);
+        }
+        else if (string == "false")
+        {
+            handler.onBoolean(false);
+        }
+        else if (string == "null")
+        {
+            handler.onNull();
+        }
+        else
+        {
+            handler.onString(string);
+            parser->arena->reset();
+        }
+        break;
+    }
+    case 't':
+    case 'f':
+        if (getLiteral(parser, c == 't' ? "true" : "false"))
+        {
+            handler.onBoolean(c == 't');
+        }
+        break;
+    case 'n':
+        if (getLiteral(parser, "null"))
+        {
+            handler.onNull();
+        }
+        break;
+    default:
+        if (isNumberStart(c))
+        {
+            f64 number = getNumber(parser);
+            if (parser->status == PARSE_OK)
+            {
+                handler.onNumber(number);
+            }
+        }
+        else
+        {
+            failParse(parser, PARSE_UNEXPECTED_CHARACTER, parser->current - 1);
+        }
+        break;
+    }
+}
+
+// Parses an already loaded buffer (padded like InputFile). Malformed input is
+// reported in the result, exceptions only come from the handler.
+template <typename Handler>
+ParseResult tryEmitDocument(const char *buffer, u64 size, Handler &handler, Arena *stringArena)
+{
+    TIME_BANDWIDTH("emitDocument", size);
+    StructuralIndex index;
+    Parser parser;
+    initParser(&parser, buffer, size, &index, stringArena);
+    escapeWhitespaces(&parser);
+    emitValue(&parser, handler);
+    escapeWhitespaces(&parser);
+    if (parser.status == PARSE_OK && parser.current != parser.size)
+    {
+        failParse(&parser, PARSE_TRAILING_CHARACTERS);
+    }
+    return makeParseResult(parser.status, buffer, parser.errorOffset);
+}
+
+// Throwing version of tryEmitDocument()
+template <typename Handler>
+void emitDocument(const char *buffer, u64 size, Handler &handler, Arena *stringArena)
+{
+    ParseResult result = tryEmitDocument(buffer, size, handler, stringArena);
+    if (!result.ok())
+    {
+        char message[128];
+        formatParseResult(result, message, sizeof(message));
+        throw std::runtime_error(message);
+    }
+}
+
+// Memory stays flat whatever the input size: the input itself (use mmap to
+// keep it out of the heap), a fixed size structural window and a scratch
+// arena for unescaped strings. Malformed input is reported in the result,
+// exceptions only come from the handler.
+template <typename Handler>
+ParseResult parseEvents(const char *inputFileName, Handler &handler, const LoadOptions &options = LoadOptions())
+{
+    Arena inputArena = Arena();
+    Arena stringArena = Arena();
+    InputFile input = InputFile();
+
+    try
+    {
+        openInputFile(inputFileName, &input, options, &inputArena);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
+    }
+    catch (const std::exception &)
+    {
+        return makeParseResult(PARSE_IO_ERROR, NULL, 0);
     }
 
+    ParseResult result;
     try
     {
-        double d;
-        std::from_chars(buffer + start, buffer + *current, d);
-        // return strtod(buffer + start, nullptr);
-        return d;
+        result = tryEmitDocument(input.data, input.size, handler, &stringArena);
+    }
+    catch (const std::bad_alloc &)
+    {
+        result = makeParseResult(PARSE_OUT_OF_MEMORY, NULL, 0);
     }
-    catch (const std::out_of_range &e)
+    catch (...)
     {
-        // throw std::runtime_error("Invalid number, too large : \"" + std::string(number) + "\"");
+        closeInputFile(&input);
+        throw;
     }
+    closeInputFile(&input);
+    return result;
 }
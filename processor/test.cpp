@@ -1,6 +1,54 @@
 #include <stdio.h>
 #include "parser.h"
+#include "JsonTape.h"
+#include "pairs.h"
+#include "Batch.h"
+#include "solver/solver.h"
+#include "solver/sum.h"
+#include "solver/verify.h"
 #include <cassert>
+#include <random>
+
+struct CountingHandler : SaxHandler
+{
+    int objects = 0;
+    int arrays = 0;
+    int keys = 0;
+    int strings = 0;
+    int booleans = 0;
+    int nulls = 0;
+    f64 numbersSum = 0;
+
+    void onObjectBegin() { objects++; }
+    void onArrayBegin() { arrays++; }
+    void onKey(String) { keys++; }
+    void onString(String) { strings++; }
+    void onNumber(f64 value) { numbersSum += value; }
+    void onBoolean(bool) { booleans++; }
+    void onNull() { nulls++; }
+};
+
+// A new file holding text, for a test to read and unlink before it asserts
+static std::string writeTemporaryFile(const std::string &text)
+{
+    char name[] = "/tmp/haversine_test_XXXXXX";
+    int file = mkstemp(name);
+    assert(file >= 0);
+    ssize_t written = write(file, text.data(), text.size());
+    close(file);
+    assert(written == (ssize_t)text.size());
+    return name;
+}
+
+// parseNumber() reads up to 8 bytes past the number, so literals get the zero
+// padding of InputFile first
+static bool parsePaddedNumber(const char *text, f64 *value)
+{
+    char padded[64] = {};
+    assert(strlen(text) + 8 < sizeof(padded));
+    memcpy(padded, text, strlen(text));
+    return parseNumber(padded, value) != NULL;
+}
 
 int main(int argc, char const *argv[])
 {
@@ -14,11 +62,11 @@ int main(int argc, char const *argv[])
     assert(json["hello"]["sava"].size() == 0);
     printf("\t✅ Can access to object size\n");
 
-    assert(strcmp(json["hello"]["coucou"].string, "hadopire") == 0);
+    assert(json["hello"]["coucou"].string == "hadopire");
     printf("\t✅ Can access to object string member\n");
 
     assert(json[0].size() == 3);
-    assert(strcmp(json[0][0].string, "hadopire") == 0);
+    assert(json[0][0].string == "hadopire");
     printf("\t✅ Can access to object size by index\n");
 
     assert(json["array"].size() == 2);
@@ -26,12 +74,12 @@ int main(int argc, char const *argv[])
     assert(json["array"][1].size() == 3);
     printf("\t✅ Can access to array size\n");
 
-    assert(strcmp(json["array"][0][0].string, "a") == 0);
-    assert(strcmp(json["array"][0][1].string, "b") == 0);
-    assert(strcmp(json["array"][0][2].string, "c") == 0);
-    assert(strcmp(json["array"][1][0].string, "d") == 0);
-    assert(strcmp(json["array"][1][1].string, "e") == 0);
-    assert(strcmp(json["array"][1][2].string, "f") == 0);
+    assert(json["array"][0][0].string == "a");
+    assert(json["array"][0][1].string == "b");
+    assert(json["array"][0][2].string == "c");
+    assert(json["array"][1][0].string == "d");
+    assert(json["array"][1][1].string == "e");
+    assert(json["array"][1][2].string == "f");
     printf("\t✅ Can access to array string member\n");
 
     assert(json["true"].boolean == true);
@@ -53,12 +101,623 @@ int main(int argc, char const *argv[])
     const char *fileName2 = "processor/test2.json";
     Json json2 = parse(fileName2);
 
-    assert(strcmp(json2["glossary"]["title"].string, "example glossary") == 0);
-    assert(strcmp(json2["glossary"]["GlossDiv"]["title"].string, "S") == 0);
-    assert(strcmp(json2["glossary"]["GlossDiv"]["GlossList"]["GlossEntry"]["ID"].string, "SGML") == 0);
-    assert(strcmp(json2["glossary"]["GlossDiv"]["GlossList"]["GlossEntry"]["GlossDef"]["GlossSeeAlso"][0].string, "GML") == 0);
+    assert(json2["glossary"]["title"].string == "example glossary");
+    assert(json2["glossary"]["GlossDiv"]["title"].string == "S");
+    assert(json2["glossary"]["GlossDiv"]["GlossList"]["GlossEntry"]["ID"].string == "SGML");
+    assert(json2["glossary"]["GlossDiv"]["GlossList"]["GlossEntry"]["GlossDef"]["GlossSeeAlso"][0].string == "GML");
     printf("\t✅ Can access to nested object\n");
 
+    assert(json2["glossary"]["escaped"].string == "say \"hi\"\\\n\xc3\xa9\xf0\x9f\x98\x80");
+    assert(json2["glossary"]["title"].string.data >= json2.input.data);
+    assert(json2["glossary"]["title"].string.data < json2.input.data + json2.input.size);
+    printf("\t✅ Can unescape strings and view the others in place\n");
+
+    LoadOptions mapped = LoadOptions();
+    mapped.mode = LoadOptions::MMAP;
+    mapped.populate = true;
+    Json json3 = parse(fileName2, mapped);
+    assert(json3.input.mapping != NULL);
+    assert(json3.input.data[json3.input.size] == '\0');
+    assert(json3["glossary"]["GlossDiv"]["GlossList"]["GlossEntry"]["GlossDef"]["GlossSeeAlso"][1].string == "XML");
+    String escaped = json2["glossary"]["escaped"].string;
+    assert(json3["glossary"]["escaped"].string.equals(escaped.data, escaped.length));
+    printf("\t✅ Can parse a memory mapped file\n");
+
+    const char *tricky = "{\"a\\\\\":[1, \"\\\"x\\\\\\\"\" ,true],\"b\":  -2.5e3 }";
+    char block[256] = {0};
+    u64 trickySize = strlen(tricky);
+    memcpy(block, tricky, trickySize);
+    u64 scalarBits[1], simdBits[1];
+    buildStructuralIndex(block, trickySize, scalarBits, KERNEL_SCALAR);
+    buildStructuralIndex(block, trickySize, simdBits, getStructuralKernel());
+    assert(memcmp(scalarBits, simdBits, sizeof(u64)) == 0);
+    u64 position = nextStructural(scalarBits, trickySize, 2);
+    assert(block[position] == '"' && block[position + 1] == ':');
+    position = nextStructural(scalarBits, trickySize, 12);
+    assert(position == 19);
+    position = nextStructural(scalarBits, trickySize, 33);
+    assert(block[position] == '-');
+    printf("\t✅ Can index structural characters\n");
+
+    CountingHandler handler = CountingHandler();
+    assert(parseEvents(fileName, handler).ok());
+    assert(handler.objects == 4);
+    assert(handler.arrays == 4);
+    assert(handler.keys == 9);
+    assert(handler.strings == 7);
+    assert(handler.booleans == 2);
+    assert(handler.nulls == 1);
+    assert(handler.numbersSum == 1 + 2231 + 9956567912364354 + 0.1 + 0.01212054821 + 1.1e10 + 1.1e-2 + 1.1e2);
+    printf("\t✅ Can stream parse events without building a tree\n");
+
+    Pairs pairs = Pairs();
+    assert(parsePairs("processor/test3.json", &pairs).ok());
+    assert(pairs.specialized);
+    assert(pairs.count == 2);
+    assert(pairs.x0[0] == -12.5 && pairs.y0[0] == 45.25 && pairs.x1[0] == 100 && pairs.y1[0] == -3.75);
+    assert(pairs.x0[1] == 1 && pairs.y0[1] == 2 && pairs.x1[1] == 3 && pairs.y1[1] == 4);
+    assert(parsePairs("processor/test4.json", &pairs).ok());
+    assert(!pairs.specialized);
+    assert(pairs.count == 2);
+    assert(pairs.x0[0] == -12.5 && pairs.y0[0] == 45.25 && pairs.x1[0] == 100 && pairs.y1[0] == -3.75);
+    assert(pairs.x0[1] == 1 && pairs.y0[1] == 2 && pairs.x1[1] == 3 && pairs.y1[1] == 4);
+    // objects in the other arrays of the root aren't pairs
+    std::string metaFileName = writeTemporaryFile("{\"meta\": [{\"a\": 1}], \"pairs\": [{\"x0\": 1, \"y0\": 2, \"x1\": 3, \"y1\": 4,"
+                                                  " \"tags\": [{\"x0\": 9}]}], \"more\": [{\"x0\": 5}]}");
+    Pairs metaPairs = Pairs();
+    ParseResult parsedMeta = parsePairs(metaFileName.c_str(), &metaPairs);
+    unlink(metaFileName.c_str());
+    assert(parsedMeta.ok() && !metaPairs.specialized && metaPairs.count == 1);
+    assert(metaPairs.x0[0] == 1 && metaPairs.y0[0] == 2 && metaPairs.x1[0] == 3 && metaPairs.y1[0] == 4);
+    printf("\t✅ Can decode pairs into columns, with and without the fast path\n");
+
+    Pairs chunks[3];
+    assert(parsePairsParallel("processor/test3.json", chunks, 3).ok());
+    assert(chunks[0].specialized);
+    assert(chunks[0].count + chunks[1].count + chunks[2].count == 2);
+    Pairs *last = chunks[2].count ? &chunks[2] : &chunks[1];
+    assert(last->x0[last->count - 1] == 1 && last->y1[last->count - 1] == 4);
+    printf("\t✅ Can decode pairs in parallel chunks\n");
+
+    Pairs binaryPairs = Pairs();
+    assert(loadBinaryPairs("processor/test3.bin", &binaryPairs).ok());
+    assert(binaryPairs.count == 2);
+    assert(binaryPairs.x0[0] == -12.5 && binaryPairs.y0[0] == 45.25 && binaryPairs.x1[0] == 100 && binaryPairs.y1[0] == -3.75);
+    assert(binaryPairs.x0[1] == 1 && binaryPairs.y0[1] == 2 && binaryPairs.x1[1] == 3 && binaryPairs.y1[1] == 4);
+    assert(loadBinaryPairs("processor/test3.json", &binaryPairs).status == PARSE_INVALID_BINARY);
+    assert(binaryPairs.count == 0);
+    printf("\t✅ Can map binary pairs without parsing\n");
+
+    // tiny blocks so every token gets cut by a block boundary at some point
+    StreamOptions tinyBlocks = StreamOptions();
+    tinyBlocks.bufferSize = 7;
+    tinyBlocks.carryCapacity = 128;
+    tinyBlocks.bufferCount = 2;
+    Pairs batch = Pairs();
+    f64 streamed[4] = {};
+    u64 batches = 0;
+    assert(streamPairsFile("processor/test3.json", &batch, 1, [&](Pairs *pairs)
+                           {
+                               assert(pairs->count == 1);
+                               streamed[batches * 2] = pairs->x0[0];
+                               streamed[batches * 2 + 1] = pairs->y1[0];
+                               batches++; },
+                           tinyBlocks)
+               .ok());
+    assert(batches == 2);
+    assert(streamed[0] == -12.5 && streamed[1] == -3.75 && streamed[2] == 1 && streamed[3] == 4);
+    // another shape isn't an error, it needs the generic parser
+    assert(streamPairsFile("processor/test4.json", &batch, 16, [&](Pairs *) {}, tinyBlocks).status == PARSE_UNEXPECTED_SHAPE);
+    printf("\t✅ Can stream pairs through small buffers\n");
+
+    // differential test against from_chars: random doubles in every format the
+    // generator ever wrote, plus random digit strings of any length
+    std::mt19937_64 rng(42);
+    char text[128];
+    for (int i = 0; i < 200000; i++)
+    {
+        u64 bits = rng();
+        f64 random;
+        memcpy(&random, &bits, sizeof(random));
+        if (random != random || random - random != 0)
+        {
+            continue;
+        }
+        for (int format = 0; format < 4; format++)
+        {
+            int length = 0;
+            if (format == 0)
+            {
+                length = std::to_chars(text, text + 64, random).ptr - text;
+            }
+            else if (format == 1)
+            {
+                length = snprintf(text, 64, "%.20f", rng() / (f64)rng.max() * 360.0 - 180.0);
+            }
+            else if (format == 2)
+            {
+                length = snprintf(text, 64, "%.*e", (int)(rng() % 25), random);
+            }
+            else
+            {
+                length += rng() % 2 ? snprintf(text, 64, "-") : 0;
+                // a leading 0 stands alone
+                text[length++] = '0' + rng() % 10;
+                for (int digits = text[length - 1] == '0' ? 0 : rng() % 30; digits > 0; digits--)
+                {
+                    text[length++] = '0' + rng() % 10;
+                }
+                text[length++] = '.';
+                for (int digits = 1 + rng() % 30; digits > 0; digits--)
+                {
+                    text[length++] = '0' + rng() % 10;
+                }
+                length += snprintf(text + length, 16, "e%d", (int)(rng() % 700) - 350);
+            }
+            memset(text + length, 0, 16);
+
+            // out of range for from_chars: +-inf or +-0 like strtod
+            f64 expected;
+            if (std::from_chars(text, text + length, expected).ec != std::errc())
+            {
+                expected = strtod(text, NULL);
+                assert(expected == 0 || isinf(expected));
+            }
+            f64 number;
+            assert(parseNumber(text, &number) == text + length);
+            assert(memcmp(&number, &expected, sizeof(number)) == 0);
+        }
+    }
+    f64 number;
+    assert(!parsePaddedNumber("-", &number) && !parsePaddedNumber("1.", &number) && !parsePaddedNumber("1e", &number));
+    assert(!parsePaddedNumber("01", &number) && !parsePaddedNumber("-00.5", &number) && !parsePaddedNumber("00", &number));
+    assert(parsePaddedNumber("0.5", &number) && number == 0.5 && parsePaddedNumber("-0e3", &number) && number == 0 && signbit(number));
+    assert(parsePaddedNumber("1e400", &number) && number == INFINITY && parsePaddedNumber("-1e99999999999", &number) && number == -INFINITY);
+    assert(parsePaddedNumber("1e-400", &number) && number == 0 && !signbit(number));
+    assert(parsePaddedNumber("-2e-324", &number) && number == 0 && signbit(number));
+    std::string hugeNumber = "1" + std::string(400, '0') + ".5";
+    hugeNumber.append(16, '\0');
+    assert(parseNumber(hugeNumber.c_str(), &number) && number == INFINITY);
+    printf("\t✅ Can decode numbers exactly like from_chars, and out of range ones like strtod\n");
+
+    f64 distances[2];
+    f64 sum = batchHaversine(pairs.x0, pairs.y0, pairs.x1, pairs.y1, 2, 6372.8, distances, HAVERSINE_REFERENCE);
+    assert(distances[0] == referenceHaversine(-12.5, 45.25, 100, -3.75, 6372.8));
+    assert(distances[1] == referenceHaversine(1, 2, 3, 4, 6372.8));
+    assert(sum == distances[0] + distances[1]);
+    HaversineKernel kernels[2] = {HAVERSINE_AVX2, HAVERSINE_AVX512};
+    for (int i = 0; i < 2; i++)
+    {
+        if (kernels[i] > getHaversineKernel())
+        {
+            continue;
+        }
+        f64 approximated[2];
+        batchHaversine(pairs.x0, pairs.y0, pairs.x1, pairs.y1, 2, 6372.8, approximated, kernels[i]);
+        assert(fabs(approximated[0] - distances[0]) < 1e-9 && fabs(approximated[1] - distances[1]) < 1e-9);
+    }
+    printf("\t✅ Can compute haversine distances in batches\n");
+
+    // 1 + 2^-53 + ... loses every small term when added left to right
+    f64 values[6] = {1.0, ldexp(1.0, -53), ldexp(1.0, -53), -1.0, 0.1, 1e-300};
+    Sum naive, compensated, whole, left, right;
+    initSum(&naive, SUM_NAIVE);
+    initSum(&compensated, SUM_NEUMAIER);
+    initSum(&whole, SUM_EXACT);
+    initSum(&left, SUM_EXACT);
+    initSum(&right, SUM_EXACT);
+    for (int i = 0; i < 6; i++)
+    {
+        addToSum(&naive, values[i]);
+        addToSum(&compensated, values[i]);
+        addToSum(&whole, values[i]);
+        addToSum(i % 2 ? &left : &right, values[5 - i]);
+    }
+    mergeSum(&left, &right);
+    assert(getSum(&naive) == 0.1);
+    assert(getSum(&compensated) == 0.1 + ldexp(1.0, -52));
+    assert(getSum(&whole) == 0.1 + ldexp(1.0, -52));
+    assert(getSum(&left) == getSum(&whole));
+    printf("\t✅ Can sum exactly whatever the order and the split\n");
+
+    Json reused = Json();
+    parse(fileName2, reused);
+    size_t capacity = reused.arena.getCapacity();
+    size_t used = reused.arena.getUsed();
+    parse(fileName2, reused);
+    assert(reused.arena.getCapacity() == capacity);
+    assert(reused.arena.getUsed() == used);
+    assert(reused["glossary"]["GlossDiv"]["title"].string == "S");
+    printf("\t✅ Can reuse the document arena across parses\n");
+
+    // print, parse the output again and print it again: both texts must match
+    const char *compact = json2.print(false);
+    std::string printedFileName = writeTemporaryFile("");
+    int printedFile = open(printedFileName.c_str(), O_WRONLY);
+    json2.print(printedFile, false);
+    close(printedFile);
+    Json printed = parse(printedFileName.c_str());
+    unlink(printedFileName.c_str());
+    assert(printedFile >= 0);
+    assert(strcmp(printed.print(false), compact) == 0);
+    assert(printed["glossary"]["escaped"].string.equals(escaped.data, escaped.length));
+    assert(strstr(compact, "\"say \\\"hi\\\"\\\\\\n") != NULL);
+    printf("\t✅ Can print documents and parse them back\n");
+
+    // print writes true, false and null bare, and null for a non-finite number
+    std::string literalsFileName = writeTemporaryFile("{\"on\": true, \"off\": false, \"none\": null, \"list\": [false,null,true, 1]}");
+    Json literals = parse(literalsFileName.c_str());
+    literals["list"][3].number = INFINITY;
+    const char *literalsText = literals.print(false);
+    int literalsFile = open(literalsFileName.c_str(), O_WRONLY | O_TRUNC);
+    literals.print(literalsFile, false);
+    close(literalsFile);
+    Json reparsed = parse(literalsFileName.c_str());
+    JsonTape literalsTape = parseTape(literalsFileName.c_str(), LoadOptions(), true);
+    CountingHandler literalsHandler = CountingHandler();
+    ParseResult literalsEvents = parseEvents(literalsFileName.c_str(), literalsHandler);
+    unlink(literalsFileName.c_str());
+    assert(literalsFile >= 0);
+    assert(strcmp(reparsed.print(false), literalsText) == 0 && strcmp(literalsTape.print(false), literalsText) == 0);
+    assert(reparsed["on"].boolean && !reparsed["off"].boolean && reparsed["none"].type == Value::NULL_VALUE);
+    assert(reparsed["list"][3].type == Value::NULL_VALUE);
+    assert(literalsTape["on"].getBoolean() && !literalsTape["off"].getBoolean() && literalsTape["list"][1].isNull());
+    assert(literalsEvents.ok() && literalsHandler.booleans == 4 && literalsHandler.nulls == 3);
+    Json brokenLiterals = Json();
+    std::string brokenLiteralFileName = writeTemporaryFile("[true, nul");
+    ParseResult cutLiteral = tryParse(brokenLiteralFileName.c_str(), brokenLiterals);
+    unlink(brokenLiteralFileName.c_str());
+    brokenLiteralFileName = writeTemporaryFile("[trux]");
+    ParseResult misspelledLiteral = tryParse(brokenLiteralFileName.c_str(), brokenLiterals);
+    unlink(brokenLiteralFileName.c_str());
+    assert(cutLiteral.status == PARSE_UNEXPECTED_END && cutLiteral.offset == 10);
+    assert(misspelledLiteral.status == PARSE_UNEXPECTED_CHARACTER && misspelledLiteral.offset == 4);
+    printf("\t✅ Can parse back the literals print writes\n");
+
+    // heap and arena lists, trivially copyable and not
+    ArrayList<f64> doubles;
+    assert(doubles.getCapacity() == 0);
+    doubles.reserve(100);
+    assert(doubles.getCapacity() == 100);
+    for (int i = 0; i < 1000; i++)
+    {
+        doubles.add(i);
+    }
+    doubles.add(doubles[0]);
+    f64 doublesSum = 0;
+    for (f64 value : doubles)
+    {
+        doublesSum += value;
+    }
+    assert(doubles.getSize() == 1001 && doublesSum == 499500);
+    ArrayList<f64> movedDoubles = std::move(doubles);
+    assert(doubles.getSize() == 0 && movedDoubles[999] == 999);
+    bool threw = false;
+    try
+    {
+        movedDoubles.at(1001);
+    }
+    catch (const std::out_of_range &)
+    {
+        threw = true;
+    }
+    assert(threw);
+    Arena listArena;
+    ArrayList<std::string> strings(&listArena);
+    for (int i = 0; i < 100; i++)
+    {
+        strings.add(std::to_string(i) + " is long enough to live on the heap");
+    }
+    strings.add(strings[0]);
+    assert(strings[99] == "99 is long enough to live on the heap" && strings[100] == strings[0]);
+    printf("\t✅ Can reserve, grow and move lists\n");
+
+    // the tape has to describe the same documents as the tree
+    JsonTape tape = parseTape(fileName);
+    assert(tape.size() == 6);
+    assert(tape["hello"].size() == 3);
+    assert(tape["hello"]["coucou"].getString() == "hadopire");
+    assert(tape[0][0].getString() == "hadopire");
+    assert(tape["array"][1][2].getString() == "f");
+    assert(tape["true"].getBoolean() && !tape["false"].getBoolean() && tape["null"].isNull());
+    assert(tape["numbers"][2].getNumber() == 9956567912364354);
+    f64 tapeSum = 0;
+    for (TapeValue number : tape["numbers"])
+    {
+        tapeSum += number.getNumber();
+    }
+    f64 treeSum = 0;
+    for (Value &number : json["numbers"].array->values)
+    {
+        treeSum += number.number;
+    }
+    assert(tapeSum == treeSum);
+    const char *tapeFiles[] = {fileName, fileName2, "processor/test3.json", "processor/test4.json"};
+    for (const char *tapeFile : tapeFiles)
+    {
+        Json tree = parse(tapeFile);
+        parse(tapeFile, tape);
+        assert(strcmp(tape.print(), tree.print()) == 0);
+    }
+    printf("\t✅ Can parse documents into a tape\n");
+
+    // lazy tapes decode on read, errors in skipped values never surface
+    for (const char *tapeFile : tapeFiles)
+    {
+        Json tree = parse(tapeFile);
+        parse(tapeFile, tape, LoadOptions(), true);
+        assert(strcmp(tape.print(), tree.print()) == 0);
+    }
+    parse(fileName2, tape, LoadOptions(), true);
+    assert(tape["glossary"]["escaped"].getString().equals(escaped.data, escaped.length));
+    std::string lazyFileName = writeTemporaryFile("{\"good\": [1.5, -2e3], \"bad\": [1.2.3, -]}");
+    JsonTape strictTape;
+    ParseResult tapeResult = tryParse(lazyFileName.c_str(), strictTape);
+    parse(lazyFileName.c_str(), tape, LoadOptions(), true);
+    unlink(lazyFileName.c_str());
+    assert(tapeResult.status == PARSE_EXPECTED_ARRAY_END && tapeResult.offset == 33);
+    assert(strictTape.root().isNull());
+    assert(tape["good"][0].getNumber() == 1.5 && tape["good"][1].getNumber() == -2e3);
+    assert(tape["bad"].size() == 2);
+    threw = false;
+    try
+    {
+        tape["bad"][0].getNumber();
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    assert(threw);
+    printf("\t✅ Can decode tape values lazily\n");
+
+    // every parser stops at the first error and says where it is
+    std::string malformedFileName = writeTemporaryFile("{\"a\": [1, 2],\n \"b\": {\"c\" 3}}");
+    Json malformed = Json();
+    ParseResult result = tryParse(malformedFileName.c_str(), malformed);
+    ParseResult tapeMalformed = tryParse(malformedFileName.c_str(), tape);
+    InputFile malformedInput = InputFile();
+    Arena malformedArena;
+    openInputFile(malformedFileName.c_str(), &malformedInput, LoadOptions(), &malformedArena);
+    CountingHandler malformedHandler = CountingHandler();
+    ParseResult emitMalformed = tryEmitDocument(malformedInput.data, malformedInput.size, malformedHandler, &malformedArena);
+    closeInputFile(&malformedInput);
+    Json thrown = Json();
+    threw = false;
+    try
+    {
+        parse(malformedFileName.c_str(), thrown);
+    }
+    catch (const std::runtime_error &e)
+    {
+        threw = strcmp(e.what(), "Expected ':' at line 2, column 12 (byte 25)") == 0;
+    }
+    unlink(malformedFileName.c_str());
+    assert(result.status == PARSE_EXPECTED_COLON && result.offset == 25 && result.line == 2 && result.column == 12);
+    assert(malformed.value.type == Value::NULL_VALUE);
+    assert(tapeMalformed.status == PARSE_EXPECTED_COLON && tapeMalformed.line == 2 && tapeMalformed.column == 12);
+    assert(emitMalformed.status == PARSE_EXPECTED_COLON && emitMalformed.offset == 25);
+    assert(threw);
+    assert(tryParse("processor/missing.json", malformed).status == PARSE_IO_ERROR);
+    assert(tryParse(fileName, malformed).ok() && malformed["true"].boolean);
+    printf("\t✅ Can report the position of parse errors without throwing\n");
+
+    // one value 3 ULP off and one 1 ULP off among 100 exact ones
+    assert(getUlpDistance(1.0, nextafter(1.0, 2.0)) == 1 && getUlpDistance(-0.0, 0.0) == 0);
+    assert(getUlpDistance(nextafter(0.0, -1.0), nextafter(0.0, 1.0)) == 2);
+    f64 answers[100];
+    f64 computed[100];
+    for (int i = 0; i < 100; i++)
+    {
+        answers[i] = computed[i] = 1000.0 + i;
+    }
+    computed[37] = nextafter(nextafter(nextafter(answers[37], 0.0), 0.0), 0.0);
+    computed[90] = nextafter(answers[90], 2000.0);
+    VerifyOptions verifyOptions = VerifyOptions();
+    verifyOptions.maxUlp = 1;
+    VerifyReport report;
+    initVerifyReport(&report);
+    verifyValues(computed, answers, 50, 0, verifyOptions, &report);
+    VerifyReport secondHalf;
+    initVerifyReport(&secondHalf);
+    verifyValues(computed + 50, answers + 50, 50, 50, verifyOptions, &secondHalf);
+    mergeVerifyReport(&report, &secondHalf, verifyOptions);
+    assert(report.compared == 100 && report.mismatches == 1 && report.maxUlp == 3 && report.maxUlpIndex == 37);
+    assert(report.histogram[0] == 98 && report.histogram[1] == 1 && report.histogram[2] == 1);
+    assert(report.offenderCount == 1 && report.offenders[0].index == 37);
+    printf("\t✅ Can verify distances within a tolerance\n");
+
+    // objects with the same keys share a shape and one copy of each key,
+    // wide ones are hashed, duplicated keys resolve to the first one
+    std::string shapesText = "{\"same\": [{\"a\": 1, \"b\": 2}, {\"a\": 3, \"b\": 4}, {\"b\": 5, \"a\": 6}], \"wide\": {";
+    for (int i = 0; i < 40; i++)
+    {
+        shapesText += "\"k" + std::to_string(i) + "\": " + std::to_string(i) + ", ";
+    }
+    shapesText += "\"k7\": -1}}";
+    std::string shapesFileName = writeTemporaryFile(shapesText);
+    Json shaped = parse(shapesFileName.c_str());
+    unlink(shapesFileName.c_str());
+    Value &same = shaped["same"];
+    assert(same[0].object->shape == same[1].object->shape && same[0].object->shape != same[2].object->shape);
+    assert(same[0].object->members[0].name.data == same[2].object->members[1].name.data);
+    MemberKey a("a");
+    assert(same[0][a].number == 1 && same[1][a].number == 3 && same[2][a].number == 6);
+    assert(a.slot == 1 && same[0]["b"].number == 2);
+    Value &wide = shaped["wide"];
+    assert(wide.size() == 41 && wide.object->shape->index != NULL);
+    assert(wide["k0"].number == 0 && wide["k39"].number == 39 && wide["k7"].number == 7);
+    threw = false;
+    try
+    {
+        wide["k40"];
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    assert(threw);
+    printf("\t✅ Can share shapes and keys between objects\n");
+
+    // the same columns from the tree and from the input, in one pass each
+    std::string queryFileName = writeTemporaryFile("{\"pairs\": [{\"x0\": 1, \"y0\": 2}, {\"y0\": 4, \"x0\": 3, \"deep\": {\"x0\": 99}}, {\"x0\": \"no\"}],"
+                                                   " \"a/b\": {\"k\": [10, 20, 30], \"01\": 7}, \"m~n\": 5}");
+    Json queried = parse(queryFileName.c_str());
+    InputFile queryInput = InputFile();
+    Arena queryArena;
+    openInputFile(queryFileName.c_str(), &queryInput, LoadOptions(), &queryArena);
+    unlink(queryFileName.c_str());
+    const char *queryPaths[] = {"/pairs/*/x0", "/pairs/*/y0", "/a~1b/k/1", "/m~0n", "/pairs/*/*", "/a~1b/k/01", "/a~1b/01"};
+    Query query;
+    assert(compileQuery(&query, queryPaths, 7));
+    const char *badPaths[] = {"pairs/x0"};
+    assert(!compileQuery(&query, badPaths, 1));
+    assert(compileQuery(&query, queryPaths, 7));
+    f64 columnValues[2][7][4];
+    for (int run = 0; run < 2; run++)
+    {
+        QueryColumn columns[7];
+        for (int i = 0; i < 7; i++)
+        {
+            initQueryColumn(&columns[i], columnValues[run][i], i == 4 ? 1 : 4);
+        }
+        if (run == 0)
+        {
+            runQuery(&query, queried, columns);
+        }
+        else
+        {
+            runQuery(&query, queryInput.data, queryInput.size, columns, &queryArena);
+        }
+        assert(columns[0].count == 2 && columnValues[run][0][0] == 1 && columnValues[run][0][1] == 3);
+        assert(columns[1].count == 2 && columnValues[run][1][0] == 2 && columnValues[run][1][1] == 4);
+        assert(columns[2].count == 1 && columnValues[run][2][0] == 20);
+        assert(columns[3].count == 1 && columnValues[run][3][0] == 5);
+        // past its capacity a column only counts
+        assert(columns[4].count == 4 && columnValues[run][4][0] == 1);
+        // a leading zero makes a member name, never an index
+        assert(columns[5].count == 0);
+        assert(columns[6].count == 1 && columnValues[run][6][0] == 7);
+    }
+    closeInputFile(&queryInput);
+    printf("\t✅ Can extract columns with path queries\n");
+
+    // enough records for both rings to wrap around many times
+    std::string pipelineText = "{\"pairs\":[";
+    for (int i = 0; i < 1000; i++)
+    {
+        pipelineText += (i ? ",{\"x0\":" : "{\"x0\":") + std::to_string(i) + ",\"y0\":1.5,\"x1\":-2,\"y1\":" + std::to_string(i * 2) + "}";
+    }
+    pipelineText += "]}";
+    std::string pipelineFileName = writeTemporaryFile(pipelineText);
+    PipelineOptions pipelineOptions = PipelineOptions();
+    pipelineOptions.stream = tinyBlocks;
+    pipelineOptions.stream.bufferSize = 61;
+    pipelineOptions.batchSize = 7;
+    pipelineOptions.batchCount = 2;
+    PipelineStats pipelineStats;
+    u64 piped = 0;
+    bool pipedInOrder = true;
+    ParseResult pipelined = pipelinePairsFile(pipelineFileName.c_str(), [&](Pairs *pairs)
+                                       {
+                                           for (u64 i = 0; i < pairs->count; i++, piped++)
+                                           {
+                                               pipedInOrder &= pairs->x0[i] == piped && pairs->y0[i] == 1.5 && pairs->x1[i] == -2 && pairs->y1[i] == piped * 2;
+                                           } },
+                                       pipelineOptions, &pipelineStats);
+    u64 pipelineBatches = pipelineStats.batches;
+    // a failing stage stops the others, and its exception comes out
+    threw = false;
+    try
+    {
+        pipelinePairsFile(pipelineFileName.c_str(), [&](Pairs *)
+                          { throw std::runtime_error("Expected compute failure."); },
+                          pipelineOptions, &pipelineStats);
+    }
+    catch (const std::runtime_error &e)
+    {
+        threw = strcmp(e.what(), "Expected compute failure.") == 0;
+    }
+    unlink(pipelineFileName.c_str());
+    assert(pipelined.ok() && pipedInOrder && piped == 1000 && pipelineBatches == 143);
+    assert(threw);
+    assert(pipelinePairsFile("processor/test4.json", [&](Pairs *) {}, pipelineOptions, &pipelineStats).status == PARSE_UNEXPECTED_SHAPE);
+    printf("\t✅ Can pipeline reading, parsing and computing\n");
+
+    // a file cut short is an error at its end for every decoder, whether the
+    // cut falls between tokens, in a number or in a key
+    const char *truncatedTexts[] = {"{\"pairs\":[\n{\"x0\":1,\"y0\":2,\"x1\":3,\"y1\":4},\n{\"x0\":5,\"y0\":6,",
+                                    "{\"pairs\":[\n{\"x0\":1,\"y0\":2,\"x1\":3,\"y1\":4},\n{\"x0\":5,\"y0\":6.2",
+                                    "{\"pairs\":[\n{\"x0\":1,\"y0\":2,\"x1\":3,\"y1\":4}\n",
+                                    "{\"pairs\":[\n{\"x0\":1,\"y0\":2,\"x1\":3,\"y1\":4},\n{\"x0\":5,\"y"};
+    for (int i = 0; i < 4; i++)
+    {
+        std::string truncatedFileName = writeTemporaryFile(truncatedTexts[i]);
+        ParseResult truncated[5];
+        truncated[0] = parsePairs(truncatedFileName.c_str(), &pairs);
+        truncated[1] = queryPairs(truncatedFileName.c_str(), &pairs);
+        truncated[2] = parsePairsParallel(truncatedFileName.c_str(), chunks, 3);
+        truncated[3] = streamPairsFile(truncatedFileName.c_str(), &batch, 1, [&](Pairs *) {}, tinyBlocks);
+        truncated[4] = pipelinePairsFile(truncatedFileName.c_str(), [&](Pairs *) {}, pipelineOptions, &pipelineStats);
+        unlink(truncatedFileName.c_str());
+        // the cut key is a string that never ends, where it starts
+        u64 truncatedOffset = i < 3 ? strlen(truncatedTexts[i]) : strrchr(truncatedTexts[i], '"') - truncatedTexts[i];
+        u64 lastLine = strrchr(truncatedTexts[i], '\n') - truncatedTexts[i];
+        for (const ParseResult &result : truncated)
+        {
+            assert(result.status == (i < 3 ? PARSE_UNEXPECTED_END : PARSE_UNTERMINATED_STRING) && result.offset == truncatedOffset);
+            assert(result.line == 3 && result.column == truncatedOffset - lastLine);
+        }
+        assert(pairs.count == 0 && chunks[0].count == 0);
+    }
+    // a pair without all its coordinates
+    std::string incompleteFileName = writeTemporaryFile("{\"pairs\": [{\"x0\": 1, \"y0\": 2, \"x1\": 3}]}");
+    ParseResult incomplete = parsePairs(incompleteFileName.c_str(), &pairs);
+    ParseResult incompleteQuery = queryPairs(incompleteFileName.c_str(), &pairs);
+    unlink(incompleteFileName.c_str());
+    assert(incomplete.status == PARSE_MISSING_COORDINATES && incompleteQuery.status == PARSE_MISSING_COORDINATES);
+    assert(parsePairs("processor/missing.json", &pairs).status == PARSE_IO_ERROR);
+    assert(streamPairsFile("processor/missing.json", &batch, 1, [&](Pairs *) {}).status == PARSE_IO_ERROR);
+    printf("\t✅ Can report malformed pairs files from every decoder\n");
+
+    // a directory lists its coordinates with their results, and the queue
+    // hands out the largest files first
+    char batchDirectory[] = "/tmp/haversine_batch_XXXXXX";
+    assert(mkdtemp(batchDirectory));
+    std::string batchPrefix = std::string(batchDirectory) + "/";
+    const char *batchNames[] = {"coordinates_a.json", "coordinates_b.json", "results_b.f64", "other.json", "manifest.txt"};
+    const std::string batchTexts[] = {std::string(10, ' '), std::string(30, ' '), std::string(8, ' '), std::string(5, ' '),
+                                      "# inputs\ncoordinates_a.json\n\n  coordinates_b.json results_b.f64\nmissing.json\n"};
+    for (int i = 0; i < 5; i++)
+    {
+        std::string path = writeTemporaryFile(batchTexts[i]);
+        assert(rename(path.c_str(), (batchPrefix + batchNames[i]).c_str()) == 0);
+    }
+    std::vector<BatchFile> batchFiles;
+    bool listedDirectory = listBatchFiles(batchDirectory, &batchFiles);
+    std::vector<BatchFile> manifestFiles;
+    bool listedManifest = listBatchFiles((batchPrefix + "manifest.txt").c_str(), &manifestFiles);
+    for (const char *name : batchNames)
+    {
+        unlink((batchPrefix + name).c_str());
+    }
+    rmdir(batchDirectory);
+    assert(listedDirectory && batchFiles.size() == 2);
+    assert(batchFiles[0].answers.empty() && batchFiles[0].size == 10);
+    assert(batchFiles[1].answers == batchPrefix + "results_b.f64" && batchFiles[1].size == 30);
+    batchFiles = manifestFiles;
+    assert(listedManifest && batchFiles.size() == 3 && batchFiles[1].answers == batchPrefix + "results_b.f64");
+    assert(batchFiles[2].status == BATCH_FAILED && !batchFiles[2].error.empty() && batchFiles[0].error.empty());
+    std::vector<u64> batchOrder;
+    runBatchQueue(batchFiles, 1, [&](int, BatchFile *file)
+                  { batchOrder.push_back(file->size); });
+    assert(batchOrder.size() == 2 && batchOrder[0] == 30 && batchOrder[1] == 10);
+    std::atomic<int> batchVisits{0};
+    runBatchQueue(batchFiles, 4, [&](int, BatchFile *)
+                  { batchVisits++; });
+    assert(batchVisits == 2);
+    printf("\t✅ Can list and schedule batches of files\n");
+
     printf("Testing Json printer...\n\n");
     printf("%s", json.print());
 
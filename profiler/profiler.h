@@ -0,0 +1,216 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#define PROFILER_RDTSC
+#endif
+
+// Nested block profiler. Build with -DPROFILER=1 to enable it; otherwise the
+// zone macros expand to nothing and only beginProfile()/endAndPrintProfile()
+// remain, as empty inline functions.
+//
+//   TIME_FUNCTION;                       zone named after the enclosing function
+//   TIME_BLOCK("name");                  zone until the end of the scope
+//   TIME_BANDWIDTH("name", byteCount);   same, also reports GB/s
+//
+// Every zone keeps its exclusive time (children subtracted) and its inclusive
+// time (recursion counted once). Zones are not thread safe: only open them on
+// the main thread.
+
+#ifndef PROFILER
+#define PROFILER 0
+#endif
+
+typedef double f64;
+typedef uint64_t u64;
+typedef uint32_t u32;
+
+inline u64 getOsTimerFrequency()
+{
+    return 1000000000;
+}
+
+inline u64 readOsTimer()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000 + (u64)now.tv_nsec;
+}
+
+inline u64 readCpuTimer()
+{
+#ifdef PROFILER_RDTSC
+    return __rdtsc();
+#else
+    return readOsTimer();
+#endif
+}
+
+// Counts CPU timer ticks over a known stretch of OS time
+inline u64 estimateCpuTimerFrequency(u64 milliseconds = 100)
+{
+    u64 osFrequency = getOsTimerFrequency();
+    u64 osWait = osFrequency * milliseconds / 1000;
+
+    u64 cpuStart = readCpuTimer();
+    u64 osStart = readOsTimer();
+    u64 osElapsed = 0;
+    while (osElapsed < osWait)
+    {
+        osElapsed = readOsTimer() - osStart;
+    }
+    u64 cpuElapsed = readCpuTimer() - cpuStart;
+
+    return osElapsed ? osFrequency * cpuElapsed / osElapsed : 0;
+}
+
+struct ProfileAnchor
+{
+    const char *label;
+    // time in this zone minus the time in the zones it opened
+    u64 elapsedExclusive;
+    // time in this zone and its children, counted once when it recurses
+    u64 elapsedInclusive;
+    u64 hitCount;
+    u64 processedBytes;
+};
+
+static const u32 maxProfileAnchors = 1024;
+
+struct Profiler
+{
+    // anchor 0 stands for "no zone" and is never printed
+    ProfileAnchor anchors[maxProfileAnchors];
+    u32 anchorCount;
+    u64 start;
+    u64 end;
+};
+
+#if PROFILER
+
+inline Profiler globalProfiler;
+inline u32 globalProfilerParent;
+
+// Called once per zone through a function static, so zones can live in any
+// header or translation unit without colliding
+inline u32 getProfileAnchor(const char *label)
+{
+    u32 index = ++globalProfiler.anchorCount;
+    if (index >= maxProfileAnchors)
+    {
+        // out of anchors, share the last one rather than writing past the array
+        index = maxProfileAnchors - 1;
+        globalProfiler.anchorCount = index;
+    }
+    globalProfiler.anchors[index].label = label;
+    return index;
+}
+
+class ProfileBlock
+{
+private:
+    u32 anchorIndex;
+    u32 parentIndex;
+    u64 oldElapsedInclusive;
+    u64 start;
+
+public:
+    ProfileBlock(u32 anchorIndex, u64 byteCount = 0)
+    {
+        ProfileAnchor *anchor = &globalProfiler.anchors[anchorIndex];
+        this->anchorIndex = anchorIndex;
+        parentIndex = globalProfilerParent;
+        // a recursive call overwrites the inclusive time of its outer call
+        // when it ends, the outer call then writes the right total back
+        oldElapsedInclusive = anchor->elapsedInclusive;
+        anchor->processedBytes += byteCount;
+
+        globalProfilerParent = anchorIndex;
+        start = readCpuTimer();
+    }
+
+    ~ProfileBlock()
+    {
+        u64 elapsed = readCpuTimer() - start;
+        globalProfilerParent = parentIndex;
+
+        ProfileAnchor *parent = &globalProfiler.anchors[parentIndex];
+        ProfileAnchor *anchor = &globalProfiler.anchors[anchorIndex];
+        parent->elapsedExclusive -= elapsed;
+        anchor->elapsedExclusive += elapsed;
+        anchor->elapsedInclusive = oldElapsedInclusive + elapsed;
+        anchor->hitCount++;
+    }
+
+    ProfileBlock(const ProfileBlock &other) = delete;
+    ProfileBlock &operator=(const ProfileBlock &other) = delete;
+};
+
+#define PROFILER_JOIN_(a, b) a##b
+#define PROFILER_JOIN(a, b) PROFILER_JOIN_(a, b)
+#define TIME_BANDWIDTH(name, byteCount)                                                  \
+    static const u32 PROFILER_JOIN(profileAnchor, __LINE__) = getProfileAnchor(name);   \
+    ProfileBlock PROFILER_JOIN(profileBlock, __LINE__)(PROFILER_JOIN(profileAnchor, __LINE__), byteCount)
+#define TIME_BLOCK(name) TIME_BANDWIDTH(name, 0)
+#define TIME_FUNCTION TIME_BLOCK(__func__)
+
+inline void beginProfile()
+{
+    globalProfiler.start = readCpuTimer();
+}
+
+inline void printProfileAnchor(const ProfileAnchor *anchor, u64 totalElapsed, u64 frequency)
+{
+    f64 percent = 100.0 * (f64)anchor->elapsedExclusive / (f64)totalElapsed;
+    printf("  %-24s[%llu]: %llu (%.2f%%", anchor->label, (unsigned long long)anchor->hitCount, (unsigned long long)anchor->elapsedExclusive, percent);
+    if (anchor->elapsedInclusive != anchor->elapsedExclusive)
+    {
+        f64 percentWithChildren = 100.0 * (f64)anchor->elapsedInclusive / (f64)totalElapsed;
+        printf(", %.2f%% w/children", percentWithChildren);
+    }
+    printf(")");
+
+    if (anchor->processedBytes && frequency)
+    {
+        f64 seconds = (f64)anchor->elapsedInclusive / (f64)frequency;
+        f64 gigabytes = (f64)anchor->processedBytes / (1024.0 * 1024.0 * 1024.0);
+        printf("  %.3fMB at %.2fGB/s", (f64)anchor->processedBytes / (1024.0 * 1024.0), gigabytes / seconds);
+    }
+    printf("\n");
+}
+
+inline void endAndPrintProfile()
+{
+    globalProfiler.end = readCpuTimer();
+    u64 frequency = estimateCpuTimerFrequency();
+    u64 totalElapsed = globalProfiler.end - globalProfiler.start;
+
+    printf("\nTotal time: %.4fms (CPU freq %llu)\n", frequency ? 1000.0 * (f64)totalElapsed / (f64)frequency : 0.0, (unsigned long long)frequency);
+    for (u32 i = 1; i <= globalProfiler.anchorCount; i++)
+    {
+        ProfileAnchor *anchor = &globalProfiler.anchors[i];
+        if (anchor->hitCount)
+        {
+            printProfileAnchor(anchor, totalElapsed, frequency);
+        }
+    }
+}
+
+#else
+
+#define TIME_BANDWIDTH(name, byteCount)
+#define TIME_BLOCK(name)
+#define TIME_FUNCTION
+
+inline void beginProfile()
+{
+}
+
+inline void endAndPrintProfile()
+{
+}
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+typedef double f64;
+typedef uint64_t u64;
+typedef uint32_t u32;
+
+// Binary coordinate file written by the generator next to the JSON: a 64 byte
+// header followed by the x0, y0, x1 and y1 columns, count f64 each, little
+// endian. The processor maps it and computes straight from the columns.
+
+static const char binaryPairsMagic[8] = {'H', 'A', 'V', 'P', 'A', 'I', 'R', 'S'};
+static const u32 binaryPairsVersion = 1;
+
+enum BinaryPairsLayout
+{
+    // four columns one after the other
+    BINARY_LAYOUT_SOA = 1,
+};
+
+struct BinaryPairsHeader
+{
+    char magic[8];
+    u32 version;
+    u32 layout;
+    u64 count;
+    // getPairsChecksum() of the columns
+    u64 checksum;
+    // keeps the columns 64 byte aligned in a page aligned mapping
+    u64 reserved[4];
+};
+
+static_assert(sizeof(BinaryPairsHeader) == 64, "the columns start at byte 64");
+
+inline u64 getBinaryPairsSize(u64 count)
+{
+    return sizeof(BinaryPairsHeader) + 4 * count * sizeof(f64);
+}
+
+inline u64 getBinaryColumnOffset(u64 count, int column)
+{
+    return sizeof(BinaryPairsHeader) + column * count * sizeof(f64);
+}
+
+// One running hash per column, so a column can be hashed chunk by chunk as
+// long as the chunks come in order
+struct PairsChecksum
+{
+    u64 columns[4] = {0xcbf29ce484222325, 0xcbf29ce484222325, 0xcbf29ce484222325, 0xcbf29ce484222325};
+};
+
+inline void addToPairsChecksum(PairsChecksum *checksum, int column, const f64 *values, u64 count)
+{
+    u64 hash = checksum->columns[column];
+    for (u64 i = 0; i < count; i++)
+    {
+        u64 bits;
+        memcpy(&bits, values + i, sizeof(bits));
+        hash = (hash ^ bits) * 0x100000001b3;
+        hash ^= hash >> 29;
+    }
+    checksum->columns[column] = hash;
+}
+
+inline u64 getPairsChecksum(const PairsChecksum *checksum)
+{
+    u64 hash = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        hash = (hash ^ checksum->columns[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+inline void initBinaryPairsHeader(BinaryPairsHeader *header, u64 count, u64 checksum)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, binaryPairsMagic, sizeof(binaryPairsMagic));
+    header->version = binaryPairsVersion;
+    header->layout = BINARY_LAYOUT_SOA;
+    header->count = count;
+    header->checksum = checksum;
+}
@@ -0,0 +1,179 @@
+// Lane-wise haversine, included once per instruction set by solver.cpp inside
+// its own namespace, after defining:
+//   LANES_TARGET   target attribute of every function below
+//   LANES_COUNT    number of f64 lanes
+//   lanes_f64      vector of LANES_COUNT doubles
+//   lanes_i64      vector of LANES_COUNT int64
+//   sqrtLanes()    lane-wise square root
+// The math only uses GCC/Clang vector extensions so both widths share it.
+//
+// sin/cos/asin follow fdlibm: reduction by pi/2 with a two-part constant,
+// then the __kernel_sin/__kernel_cos polynomials and the asin rational
+// approximation. Arguments never leave [-pi, pi] here, which keeps the
+// reduction exact enough without Payne-Hanek.
+
+#define LANES_FUNCTION static inline __attribute__((target(LANES_TARGET), always_inline))
+
+LANES_FUNCTION lanes_f64 selectLanes(lanes_i64 mask, lanes_f64 a, lanes_f64 b)
+{
+    return (lanes_f64)(((lanes_i64)a & mask) | ((lanes_i64)b & ~mask));
+}
+
+// sin(x) when offset is 0, cos(x) when offset is 1
+LANES_FUNCTION lanes_f64 sinCosLanes(lanes_f64 x, long long offset)
+{
+    const f64 roundMagic = 6755399441055744.0; // 1.5 * 2^52
+    const f64 twoOverPi = 6.36619772367581382433e-01;
+    const f64 pio2Hi = 1.57079632679489655800e+00;
+    const f64 pio2Lo = 6.12323399573676603587e-17;
+
+    // nearest multiple of pi/2, its integer value ends up in the low mantissa bits
+    lanes_f64 shifted = x * twoOverPi + roundMagic;
+    lanes_i64 quadrant = (lanes_i64)shifted + offset;
+    lanes_f64 q = shifted - roundMagic;
+    lanes_f64 r = (x - q * pio2Hi) - q * pio2Lo;
+    lanes_f64 z = r * r;
+
+    const f64 S1 = -1.66666666666666324348e-01;
+    const f64 S2 = 8.33333333332248946124e-03;
+    const f64 S3 = -1.98412698298579493134e-04;
+    const f64 S4 = 2.75573137070700676789e-06;
+    const f64 S5 = -2.50507602534068634195e-08;
+    const f64 S6 = 1.58969099521155010221e-10;
+    lanes_f64 sinR = r + (z * r) * (S1 + z * (S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)))));
+
+    const f64 C1 = 4.16666666666666019037e-02;
+    const f64 C2 = -1.38888888888741095749e-03;
+    const f64 C3 = 2.48015872894767294178e-05;
+    const f64 C4 = -2.75573143513906633035e-07;
+    const f64 C5 = 2.08757232129817482790e-09;
+    const f64 C6 = -1.13596475577881948265e-11;
+    lanes_f64 halfZ = z * 0.5;
+    lanes_f64 w = 1.0 - halfZ;
+    lanes_f64 cosR = w + (((1.0 - w) - halfZ) + (z * z) * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6))))));
+
+    // odd quadrants swap sin and cos, quadrants 2 and 3 flip the sign
+    lanes_i64 useCos = -(quadrant & 1);
+    lanes_i64 sign = (quadrant & 2) << 62;
+    return (lanes_f64)((lanes_i64)selectLanes(useCos, cosR, sinR) ^ sign);
+}
+
+LANES_FUNCTION lanes_f64 asinRationalLanes(lanes_f64 t)
+{
+    const f64 pS0 = 1.66666666666666657415e-01;
+    const f64 pS1 = -3.25565818622400915405e-01;
+    const f64 pS2 = 2.01212532134862925881e-01;
+    const f64 pS3 = -4.00555345006794114027e-02;
+    const f64 pS4 = 7.91534994289814532176e-04;
+    const f64 pS5 = 3.47933107596021167570e-05;
+    const f64 qS1 = -2.40339491173441421878e+00;
+    const f64 qS2 = 2.02094576023350569471e+00;
+    const f64 qS3 = -6.88283971605453293030e-01;
+    const f64 qS4 = 7.70381505559019352791e-02;
+    lanes_f64 p = t * (pS0 + t * (pS1 + t * (pS2 + t * (pS3 + t * (pS4 + t * pS5)))));
+    lanes_f64 q = 1.0 + t * (qS1 + t * (qS2 + t * (qS3 + t * qS4)));
+    return p / q;
+}
+
+// asin for x in [0, 1], which is all haversine needs
+LANES_FUNCTION lanes_f64 asinLanes(lanes_f64 x)
+{
+    const f64 pio2Hi = 1.57079632679489655800e+00;
+    const f64 pio2Lo = 6.12323399573676603587e-17;
+    const f64 pio4Hi = 7.85398163397448278999e-01;
+
+    // x < 0.5: asin(x) = x + x * R(x^2)
+    lanes_f64 small = x + x * asinRationalLanes(x * x);
+
+    // otherwise asin(x) = pi/2 - 2 * asin(sqrt((1 - x) / 2))
+    lanes_f64 t = (1.0 - x) * 0.5;
+    lanes_f64 r = asinRationalLanes(t);
+    lanes_f64 s = sqrtLanes(t);
+    lanes_f64 large = pio2Hi - (2.0 * (s + s * r) - pio2Lo);
+
+    // below 0.975 split s so the subtraction from pi/4 keeps its low bits
+    lanes_f64 high = (lanes_f64)((lanes_i64)s & (long long)0xFFFFFFFF00000000);
+    lanes_f64 correction = (t - high * high) / (s + high);
+    lanes_f64 p = 2.0 * s * r - (pio2Lo - 2.0 * correction);
+    lanes_f64 q = pio4Hi - 2.0 * high;
+    lanes_f64 middle = pio4Hi - (p - q);
+
+    lanes_f64 result = selectLanes((lanes_i64)(x < 0.975), middle, large);
+    return selectLanes((lanes_i64)(x < 0.5), small, result);
+}
+
+LANES_FUNCTION lanes_f64 haversineLanes(lanes_f64 x0, lanes_f64 y0, lanes_f64 x1, lanes_f64 y1, f64 earthRadius)
+{
+    // same constant as radiansFromDegrees, float literal included
+    const f64 degreesToRadians = 0.01745329251994329577f;
+
+    lanes_f64 dLat = (y1 - y0) * degreesToRadians;
+    lanes_f64 dLon = (x1 - x0) * degreesToRadians;
+    lanes_f64 lat1 = y0 * degreesToRadians;
+    lanes_f64 lat2 = y1 * degreesToRadians;
+
+    lanes_f64 sinDLat = sinCosLanes(dLat * 0.5, 0);
+    lanes_f64 sinDLon = sinCosLanes(dLon * 0.5, 0);
+    lanes_f64 a = sinDLat * sinDLat + sinCosLanes(lat1, 1) * sinCosLanes(lat2, 1) * (sinDLon * sinDLon);
+    lanes_f64 c = 2.0 * asinLanes(sqrtLanes(a));
+
+    return earthRadius * c;
+}
+
+// Sums in index order, so the total matches a sequential loop over the same distances
+static __attribute__((target(LANES_TARGET))) f64 batchHaversineLanes(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1, u64 count, f64 earthRadius, f64 *distances)
+{
+    f64 sum = 0.0;
+    u64 i = 0;
+    lanes_f64 lanes;
+    for (; i + LANES_COUNT <= count; i += LANES_COUNT)
+    {
+        lanes_f64 lx0, ly0, lx1, ly1;
+        memcpy(&lx0, x0 + i, sizeof(lanes_f64));
+        memcpy(&ly0, y0 + i, sizeof(lanes_f64));
+        memcpy(&lx1, x1 + i, sizeof(lanes_f64));
+        memcpy(&ly1, y1 + i, sizeof(lanes_f64));
+        lanes = haversineLanes(lx0, ly0, lx1, ly1, earthRadius);
+
+        f64 *values = (f64 *)&lanes;
+        for (int lane = 0; lane < LANES_COUNT; lane++)
+        {
+            sum += values[lane];
+        }
+        if (distances)
+        {
+            memcpy(distances + i, &lanes, sizeof(lanes_f64));
+        }
+    }
+
+    if (i < count)
+    {
+        // zero coordinates give a zero distance, so the unused lanes are harmless
+        f64 tail[4][LANES_COUNT] = {};
+        u64 remaining = count - i;
+        memcpy(tail[0], x0 + i, remaining * sizeof(f64));
+        memcpy(tail[1], y0 + i, remaining * sizeof(f64));
+        memcpy(tail[2], x1 + i, remaining * sizeof(f64));
+        memcpy(tail[3], y1 + i, remaining * sizeof(f64));
+        lanes_f64 lx0, ly0, lx1, ly1;
+        memcpy(&lx0, tail[0], sizeof(lanes_f64));
+        memcpy(&ly0, tail[1], sizeof(lanes_f64));
+        memcpy(&lx1, tail[2], sizeof(lanes_f64));
+        memcpy(&ly1, tail[3], sizeof(lanes_f64));
+        lanes = haversineLanes(lx0, ly0, lx1, ly1, earthRadius);
+
+        f64 *values = (f64 *)&lanes;
+        for (u64 lane = 0; lane < remaining; lane++)
+        {
+            sum += values[lane];
+        }
+        if (distances)
+        {
+            memcpy(distances + i, values, remaining * sizeof(f64));
+        }
+    }
+
+    return sum;
+}
+
+#undef LANES_FUNCTION
@@ -1,4 +1,5 @@
 #include "solver.h"
+#include <string.h>
 
 static f64 square(f64 a)
 {
@@ -37,3 +38,98 @@ f64 referenceHaversine(f64 x0, f64 y0, f64 x1, f64 y1, f64 earthRadius)
 
     return Result;
 }
+
+f64 batchHaversineReference(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1, u64 count, f64 earthRadius, f64 *distances)
+{
+    f64 sum = 0.0;
+    for (u64 i = 0; i < count; i++)
+    {
+        f64 distance = referenceHaversine(x0[i], y0[i], x1[i], y1[i], earthRadius);
+        sum += distance;
+        if (distances)
+        {
+            distances[i] = distance;
+        }
+    }
+    return sum;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HAVERSINE_X64
+#include <immintrin.h>
+
+namespace avx2
+{
+typedef __m256d lanes_f64;
+typedef long long lanes_i64 __attribute__((vector_size(32)));
+#define LANES_TARGET "avx2,fma"
+#define LANES_COUNT 4
+static inline __attribute__((target(LANES_TARGET), always_inline)) lanes_f64 sqrtLanes(lanes_f64 x)
+{
+    return _mm256_sqrt_pd(x);
+}
+#include "haversine_lanes.inl"
+#undef LANES_TARGET
+#undef LANES_COUNT
+}
+
+namespace avx512
+{
+typedef __m512d lanes_f64;
+typedef long long lanes_i64 __attribute__((vector_size(64)));
+#define LANES_TARGET "avx512f,avx512dq,fma"
+#define LANES_COUNT 8
+static inline __attribute__((target(LANES_TARGET), always_inline)) lanes_f64 sqrtLanes(lanes_f64 x)
+{
+    // _mm512_sqrt_pd passes an undefined vector through the full mask, which
+    // GCC warns about once inlined
+    return _mm512_mask_sqrt_pd(_mm512_setzero_pd(), (__mmask8)-1, x);
+}
+#include "haversine_lanes.inl"
+#undef LANES_TARGET
+#undef LANES_COUNT
+}
+#endif
+
+HaversineKernel getHaversineKernel()
+{
+#ifdef HAVERSINE_X64
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+    {
+        return HAVERSINE_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return HAVERSINE_AVX2;
+    }
+#endif
+    return HAVERSINE_REFERENCE;
+}
+
+const char *getHaversineKernelName(HaversineKernel kernel)
+{
+    switch (kernel)
+    {
+    case HAVERSINE_AVX2:
+        return "avx2";
+    case HAVERSINE_AVX512:
+        return "avx512";
+    default:
+        return "reference";
+    }
+}
+
+f64 batchHaversine(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1, u64 count, f64 earthRadius, f64 *distances, HaversineKernel kernel)
+{
+#ifdef HAVERSINE_X64
+    if (kernel == HAVERSINE_AVX512)
+    {
+        return avx512::batchHaversineLanes(x0, y0, x1, y1, count, earthRadius, distances);
+    }
+    if (kernel == HAVERSINE_AVX2)
+    {
+        return avx2::batchHaversineLanes(x0, y0, x1, y1, count, earthRadius, distances);
+    }
+#endif
+    return batchHaversineReference(x0, y0, x1, y1, count, earthRadius, distances);
+}
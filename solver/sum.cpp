@@ -0,0 +1,277 @@
+#include "sum.h"
+#include <math.h>
+#include <string.h>
+
+static void normalizeExactSum(ExactSum *exact)
+{
+    // propagate carries so every limb but the top one is in [0, 2^32)
+    for (int i = 0; i < exactSumLimbs - 1; i++)
+    {
+        s64 carry = exact->limbs[i] >> 32;
+        exact->limbs[i] -= carry * ((s64)1 << 32);
+        exact->limbs[i + 1] += carry;
+    }
+    exact->pendingAdds = 0;
+}
+
+static void addToExactSum(ExactSum *exact, f64 value)
+{
+    u64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    u64 exponent = (bits >> 52) & 0x7FF;
+    u64 mantissa = bits & (((u64)1 << 52) - 1);
+
+    if (exponent == 0x7FF)
+    {
+        exact->nonFinite += value;
+        exact->hasNonFinite = true;
+        return;
+    }
+
+    // value = mantissa * 2^(position - 1074)
+    u64 position = 0;
+    if (exponent != 0)
+    {
+        mantissa |= (u64)1 << 52;
+        position = exponent - 1;
+    }
+
+    unsigned __int128 shifted = (unsigned __int128)mantissa << (position % 32);
+    int limb = position / 32;
+    s64 digits[3] = {
+        (s64)(shifted & 0xFFFFFFFF),
+        (s64)((shifted >> 32) & 0xFFFFFFFF),
+        (s64)(shifted >> 64),
+    };
+    if (bits >> 63)
+    {
+        exact->limbs[limb] -= digits[0];
+        exact->limbs[limb + 1] -= digits[1];
+        exact->limbs[limb + 2] -= digits[2];
+    }
+    else
+    {
+        exact->limbs[limb] += digits[0];
+        exact->limbs[limb + 1] += digits[1];
+        exact->limbs[limb + 2] += digits[2];
+    }
+
+    if (++exact->pendingAdds == ((u64)1 << 30))
+    {
+        normalizeExactSum(exact);
+    }
+}
+
+// Correctly rounded (to nearest, ties to even) value of the accumulator
+static f64 getExactSum(const ExactSum *source)
+{
+    if (source->hasNonFinite)
+    {
+        return source->nonFinite;
+    }
+
+    ExactSum exact = *source;
+    normalizeExactSum(&exact);
+
+    bool negative = exact.limbs[exactSumLimbs - 1] < 0;
+    if (negative)
+    {
+        for (int i = 0; i < exactSumLimbs; i++)
+        {
+            exact.limbs[i] = -exact.limbs[i];
+        }
+        normalizeExactSum(&exact);
+    }
+
+    int top = exactSumLimbs - 1;
+    while (top >= 0 && exact.limbs[top] == 0)
+    {
+        top--;
+    }
+    if (top < 0)
+    {
+        return 0.0;
+    }
+
+    // the top 3 digits hold at least 65 significant bits, the rest only
+    // matters as a sticky bit for the rounding
+    unsigned __int128 value = 0;
+    for (int i = top; i > top - 3; i--)
+    {
+        value = (value << 32) | (u64)(i >= 0 ? exact.limbs[i] : 0);
+    }
+    bool sticky = false;
+    for (int i = top - 3; i >= 0; i--)
+    {
+        sticky = sticky || exact.limbs[i] != 0;
+    }
+    int exponent = 32 * (top - 2) - 1074;
+
+    int bitCount = 0;
+    for (unsigned __int128 rest = value; rest; rest >>= 1)
+    {
+        bitCount++;
+    }
+
+    // anything that fits in 53 bits is exact, subnormals included
+    if (bitCount > 53)
+    {
+        int shift = bitCount - 53;
+        unsigned __int128 remainder = value & ((((unsigned __int128)1) << shift) - 1);
+        unsigned __int128 half = ((unsigned __int128)1) << (shift - 1);
+        value >>= shift;
+        exponent += shift;
+        if (remainder > half || (remainder == half && (sticky || (value & 1))))
+        {
+            value++;
+        }
+    }
+
+    f64 result = ldexp((f64)(u64)value, exponent);
+    return negative ? -result : result;
+}
+
+static void addToNeumaierSum(Sum *sum, f64 value)
+{
+    f64 total = sum->sum + value;
+    if (fabs(sum->sum) >= fabs(value))
+    {
+        sum->compensation += (sum->sum - total) + value;
+    }
+    else
+    {
+        sum->compensation += (value - total) + sum->sum;
+    }
+    sum->sum = total;
+}
+
+static void addToPairwiseSum(Sum *sum, f64 value)
+{
+    // merge equal sized blocks like carries in a binary counter
+    int level = 0;
+    while (sum->count & ((u64)1 << level))
+    {
+        value = sum->levels[level] + value;
+        level++;
+    }
+    sum->levels[level] = value;
+}
+
+void initSum(Sum *sum, SumMode mode)
+{
+    memset(sum, 0, sizeof(*sum));
+    sum->mode = mode;
+}
+
+void addToSum(Sum *sum, f64 value)
+{
+    switch (sum->mode)
+    {
+    case SUM_NAIVE:
+        sum->sum += value;
+        break;
+    case SUM_PAIRWISE:
+        addToPairwiseSum(sum, value);
+        break;
+    case SUM_NEUMAIER:
+        addToNeumaierSum(sum, value);
+        break;
+    case SUM_EXACT:
+        addToExactSum(&sum->exact, value);
+        break;
+    }
+    sum->count++;
+}
+
+void mergeSum(Sum *sum, const Sum *from)
+{
+    switch (sum->mode)
+    {
+    case SUM_NAIVE:
+        sum->sum += from->sum;
+        sum->count += from->count;
+        break;
+    case SUM_PAIRWISE:
+        // the other tree joins as a single leaf
+        if (from->count > 0)
+        {
+            addToPairwiseSum(sum, getSum(from));
+            sum->count++;
+        }
+        break;
+    case SUM_NEUMAIER:
+        addToNeumaierSum(sum, from->sum);
+        sum->compensation += from->compensation;
+        sum->count += from->count;
+        break;
+    case SUM_EXACT:
+    {
+        ExactSum other = from->exact;
+        normalizeExactSum(&other);
+        normalizeExactSum(&sum->exact);
+        for (int i = 0; i < exactSumLimbs; i++)
+        {
+            sum->exact.limbs[i] += other.limbs[i];
+        }
+        sum->exact.pendingAdds = 2;
+        sum->exact.nonFinite += other.nonFinite;
+        sum->exact.hasNonFinite = sum->exact.hasNonFinite || other.hasNonFinite;
+        sum->count += from->count;
+        break;
+    }
+    }
+}
+
+f64 getSum(const Sum *sum)
+{
+    switch (sum->mode)
+    {
+    case SUM_PAIRWISE:
+    {
+        f64 total = 0.0;
+        for (int level = pairwiseLevels - 1; level >= 0; level--)
+        {
+            if (sum->count & ((u64)1 << level))
+            {
+                total += sum->levels[level];
+            }
+        }
+        return total;
+    }
+    case SUM_NEUMAIER:
+        return sum->sum + sum->compensation;
+    case SUM_EXACT:
+        return getExactSum(&sum->exact);
+    default:
+        return sum->sum;
+    }
+}
+
+const char *getSumModeName(SumMode mode)
+{
+    switch (mode)
+    {
+    case SUM_PAIRWISE:
+        return "pairwise";
+    case SUM_NEUMAIER:
+        return "neumaier";
+    case SUM_EXACT:
+        return "exact";
+    default:
+        return "naive";
+    }
+}
+
+bool getSumMode(const char *name, SumMode *mode)
+{
+    SumMode modes[4] = {SUM_NAIVE, SUM_PAIRWISE, SUM_NEUMAIER, SUM_EXACT};
+    for (int i = 0; i < 4; i++)
+    {
+        if (strcmp(name, getSumModeName(modes[i])) == 0)
+        {
+            *mode = modes[i];
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef double f64;
+typedef uint64_t u64;
+typedef int64_t s64;
+
+enum SumMode
+{
+    // left to right, what the .f64 files were originally produced with
+    SUM_NAIVE,
+    // binary tree over the values in order, O(log n) error growth
+    SUM_PAIRWISE,
+    // Kahan-Babuska-Neumaier compensated summation
+    SUM_NEUMAIER,
+    // fixed point accumulator wide enough for any double, the result is the
+    // correctly rounded sum whatever the order or the split of the values
+    SUM_EXACT,
+};
+
+// 32 bit digits in 64 bit limbs: bit 0 of limb 0 is 2^-1074, the smallest
+// subnormal, and the top limbs leave room for carries out of the largest
+// finite double. Each add touches 3 limbs by less than 2^32, so limbs can take
+// 2^30 adds before carries have to be propagated.
+static const int exactSumLimbs = 68;
+
+struct ExactSum
+{
+    s64 limbs[exactSumLimbs];
+    u64 pendingAdds;
+    // infinities and NaNs are summed naively on the side
+    f64 nonFinite;
+    bool hasNonFinite;
+};
+
+static const int pairwiseLevels = 64;
+
+struct Sum
+{
+    SumMode mode;
+    u64 count;
+    // naive and Neumaier
+    f64 sum;
+    f64 compensation;
+    // pairwise: levels[i] holds the sum of a block of 2^i values when bit i of
+    // count is set, like a binary counter
+    f64 levels[pairwiseLevels];
+    ExactSum exact;
+};
+
+void initSum(Sum *sum, SumMode mode);
+void addToSum(Sum *sum, f64 value);
+// Adds everything summed in from, as if its values followed those of sum.
+// Only SUM_EXACT gives the same result however the values were split.
+void mergeSum(Sum *sum, const Sum *from);
+f64 getSum(const Sum *sum);
+
+const char *getSumModeName(SumMode mode);
+// Returns false for an unknown name
+bool getSumMode(const char *name, SumMode *mode);
@@ -0,0 +1,186 @@
+#include "verify.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VERIFY_X64
+#include <immintrin.h>
+#endif
+
+void initVerifyReport(VerifyReport *report)
+{
+    memset(report, 0, sizeof(VerifyReport));
+}
+
+// Maps the bits of a double to an integer with the same ordering, so the ULP
+// distance is a subtraction. -0 and +0 both map to 0.
+static int64_t getOrderedBits(f64 value)
+{
+    int64_t bits;
+    memcpy(&bits, &value, sizeof(f64));
+    return bits < 0 ? INT64_MIN - bits : bits;
+}
+
+u64 getUlpDistance(f64 a, f64 b)
+{
+    if (isnan(a) || isnan(b))
+    {
+        return isnan(a) && isnan(b) ? 0 : UINT64_MAX;
+    }
+    int64_t orderedA = getOrderedBits(a);
+    int64_t orderedB = getOrderedBits(b);
+    return orderedA > orderedB ? (u64)orderedA - (u64)orderedB : (u64)orderedB - (u64)orderedA;
+}
+
+static int getHistogramBucket(u64 ulp)
+{
+    return ulp ? 64 - __builtin_clzll(ulp) : 0;
+}
+
+// Returns true when the value differs from its answer, exact or not
+static bool verifyValue(f64 value, f64 expected, u64 index, const VerifyOptions &options, VerifyReport *report)
+{
+    u64 ulp = getUlpDistance(value, expected);
+    if (ulp == 0)
+    {
+        return false;
+    }
+
+    report->histogram[getHistogramBucket(ulp)]++;
+    if (ulp > report->maxUlp)
+    {
+        report->maxUlp = ulp;
+        report->maxUlpIndex = index;
+    }
+
+    // NaN differences always fail the absolute test
+    if (ulp > options.maxUlp && !(fabs(value - expected) <= options.maxAbsolute))
+    {
+        if (report->offenderCount < options.offenders && report->offenderCount < verifyMaxOffenders)
+        {
+            VerifyOffender *offender = &report->offenders[report->offenderCount++];
+            offender->index = index;
+            offender->value = value;
+            offender->expected = expected;
+            offender->ulp = ulp;
+        }
+        report->mismatches++;
+    }
+    return true;
+}
+
+static u64 verifyValuesScalar(const f64 *values, const f64 *expected, u64 count, u64 first, const VerifyOptions &options, VerifyReport *report)
+{
+    u64 different = 0;
+    for (u64 i = 0; i < count; i++)
+    {
+        // bitwise first, the answers are usually exact
+        if (memcmp(&values[i], &expected[i], sizeof(f64)) != 0)
+        {
+            different += verifyValue(values[i], expected[i], first + i, options, report);
+        }
+    }
+    return different;
+}
+
+#ifdef VERIFY_X64
+__attribute__((target("avx2"))) static u64 verifyValuesAvx2(const f64 *values, const f64 *expected, u64 count, u64 first, const VerifyOptions &options, VerifyReport *report)
+{
+    u64 different = 0;
+    u64 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(values + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(values + i + 4));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(expected + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(expected + i + 4));
+        __m256i equal = _mm256_and_si256(_mm256_cmpeq_epi64(a0, b0), _mm256_cmpeq_epi64(a1, b1));
+        if (_mm256_movemask_epi8(equal) == -1)
+        {
+            continue;
+        }
+        different += verifyValuesScalar(values + i, expected + i, 8, first + i, options, report);
+    }
+    return different + verifyValuesScalar(values + i, expected + i, count - i, first + i, options, report);
+}
+#endif
+
+void verifyValues(const f64 *values, const f64 *expected, u64 count, u64 first, const VerifyOptions &options, VerifyReport *report)
+{
+    u64 different;
+#ifdef VERIFY_X64
+    if (__builtin_cpu_supports("avx2"))
+    {
+        different = verifyValuesAvx2(values, expected, count, first, options, report);
+    }
+    else
+#endif
+    {
+        different = verifyValuesScalar(values, expected, count, first, options, report);
+    }
+    report->histogram[0] += count - different;
+    report->compared += count;
+}
+
+void mergeVerifyReport(VerifyReport *report, const VerifyReport *from, const VerifyOptions &options)
+{
+    report->compared += from->compared;
+    report->mismatches += from->mismatches;
+    if (from->maxUlp > report->maxUlp)
+    {
+        report->maxUlp = from->maxUlp;
+        report->maxUlpIndex = from->maxUlpIndex;
+    }
+    for (int bucket = 0; bucket < verifyHistogramBuckets; bucket++)
+    {
+        report->histogram[bucket] += from->histogram[bucket];
+    }
+    for (int i = 0; i < from->offenderCount; i++)
+    {
+        if (report->offenderCount < options.offenders && report->offenderCount < verifyMaxOffenders)
+        {
+            report->offenders[report->offenderCount++] = from->offenders[i];
+        }
+    }
+}
+
+void printVerifyReport(const VerifyReport *report)
+{
+    printf("Verified %llu values: %llu mismatches, max error %llu ULP",
+           (unsigned long long)report->compared, (unsigned long long)report->mismatches, (unsigned long long)report->maxUlp);
+    if (report->maxUlp > 0)
+    {
+        printf(" (value %llu)", (unsigned long long)report->maxUlpIndex);
+    }
+    printf("\n");
+
+    if (report->histogram[0] == report->compared)
+    {
+        return;
+    }
+
+    printf("  exact            %llu\n", (unsigned long long)report->histogram[0]);
+    for (int bucket = 1; bucket < verifyHistogramBuckets; bucket++)
+    {
+        if (report->histogram[bucket])
+        {
+            u64 low = (u64)1 << (bucket - 1);
+            u64 high = bucket == 64 ? UINT64_MAX : ((u64)1 << bucket) - 1;
+            char range[48];
+            snprintf(range, sizeof(range), "%llu-%llu ULP", (unsigned long long)low, (unsigned long long)high);
+            printf("  %-16s %llu\n", range, (unsigned long long)report->histogram[bucket]);
+        }
+    }
+
+    for (int i = 0; i < report->offenderCount; i++)
+    {
+        const VerifyOffender *offender = &report->offenders[i];
+        printf("  value %llu is %.20f, expected %.20f (%llu ULP)\n",
+               (unsigned long long)offender->index, offender->value, offender->expected, (unsigned long long)offender->ulp);
+    }
+    if (report->mismatches > (u64)report->offenderCount)
+    {
+        printf("  ... and %llu more\n", (unsigned long long)(report->mismatches - report->offenderCount));
+    }
+}
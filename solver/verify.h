@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef double f64;
+typedef uint64_t u64;
+
+// A value matches its answer when it is within maxUlp representable doubles
+// of it, or within maxAbsolute of it. Both 0 means bit-identical (+0 and -0
+// still match).
+struct VerifyOptions
+{
+    u64 maxUlp = 0;
+    f64 maxAbsolute = 0;
+    // mismatches kept with their details, up to verifyMaxOffenders
+    int offenders = 10;
+};
+
+struct VerifyOffender
+{
+    u64 index;
+    f64 value;
+    f64 expected;
+    u64 ulp;
+};
+
+static const int verifyMaxOffenders = 64;
+// bucket 0 counts exact matches, bucket i ULP errors in [2^(i-1), 2^i)
+static const int verifyHistogramBuckets = 65;
+
+struct VerifyReport
+{
+    u64 compared;
+    u64 mismatches;
+    u64 maxUlp;
+    u64 maxUlpIndex;
+    u64 histogram[verifyHistogramBuckets];
+    VerifyOffender offenders[verifyMaxOffenders];
+    int offenderCount;
+};
+
+void initVerifyReport(VerifyReport *report);
+
+// Distance between a and b in representable doubles, UINT64_MAX for a NaN
+u64 getUlpDistance(f64 a, f64 b);
+
+// Compares values[i] to expected[i] for count values, first is the index of
+// values[0] in the whole run so reports of several batches add up. Lanes that
+// are bit-identical are skipped 8 at a time, only differences are looked at
+// one by one.
+void verifyValues(const f64 *values, const f64 *expected, u64 count, u64 first, const VerifyOptions &options, VerifyReport *report);
+
+// Adds the report of values that came after those of report, offenders are
+// kept in order up to options.offenders
+void mergeVerifyReport(VerifyReport *report, const VerifyReport *from, const VerifyOptions &options);
+
+void printVerifyReport(const VerifyReport *report);